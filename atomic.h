@@ -14,6 +14,39 @@
 #include <condition_variable>
 #include <type_traits>
 
+#ifdef __linux__
+// Linux backend: bounded adaptive spinning, then the waiter parks on a futex
+#include <sched.h>
+#include <time.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+
+#define ATOMIC_SPIN_MIN     16          // spins before parking, grows with how long the lock is held
+#define ATOMIC_SPIN_MAX     1000
+
+static inline void atomic_cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    __asm__ __volatile__("yield" ::: "memory");
+#endif
+}
+
+static inline long atomic_futex_wait(std::atomic<int> *addr, int val, const struct timespec *timeout) {
+    return syscall(SYS_futex, (int*)addr, FUTEX_WAIT_PRIVATE, val, timeout, NULL, 0);
+}
+
+static inline long atomic_futex_wake(std::atomic<int> *addr, int count) {
+    return syscall(SYS_futex, (int*)addr, FUTEX_WAKE_PRIVATE, count, NULL, NULL, 0);
+}
+
+static inline uint64_t atomic_now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+#endif
+
 template<typename T>
 bool IsPointerAnObject(T* ptr) {
     if (!ptr) return false;
@@ -42,6 +75,35 @@ public:
     inline void init() {
         _atomic.store(0, std::memory_order_relaxed);
     }
+#ifdef __linux__
+    // _atomic: 0 unlocked, 1 locked, 2 locked and someone may be sleeping on the futex
+    inline void lock() {
+        int c = 0;
+        if (_atomic.compare_exchange_strong(c, 1, std::memory_order_acquire, std::memory_order_relaxed))
+            return;
+        
+        // Spin about as long as it recently took to get the lock (like glibc's adaptive mutex)
+        int spin = _spin.load(std::memory_order_relaxed);
+        int limit = std::min(ATOMIC_SPIN_MAX, spin * 2 + ATOMIC_SPIN_MIN);
+        int attempts = 0;
+        while (attempts < limit) {
+            atomic_cpu_relax();
+            attempts++;
+            c = _atomic.load(std::memory_order_relaxed);
+            if (c == 0 && _atomic.compare_exchange_weak(c, 1, std::memory_order_acquire, std::memory_order_relaxed)) {
+                _spin.store(spin + (attempts - spin) / 8, std::memory_order_relaxed);
+                return;
+            }
+            if (c == 2)
+                break;      // others are already parked, join them
+        }
+        _spin.store(spin + (attempts - spin) / 8, std::memory_order_relaxed);
+        
+        // Park until unlock wakes us, taking the lock as contended
+        while (_atomic.exchange(2, std::memory_order_acquire) != 0)
+            atomic_futex_wait(&_atomic, 2, NULL);
+    }
+#else
     inline void lock() {
         int expected = 0;
         int attempts = 0;
@@ -65,6 +127,7 @@ public:
             }
         }
     }
+#endif
 
     inline unsigned trylock() {
         int expected = 0;
@@ -75,6 +138,15 @@ public:
     }
     inline void wait_until_unlocked() {
         int attempts = 0;
+#ifdef __linux__
+        // unlock only wakes lockers, so watchers spin and then yield
+        while (islocked()) {
+            if (++attempts < ATOMIC_SPIN_MAX)
+                atomic_cpu_relax();
+            else
+                sched_yield();
+        }
+#else
         while (islocked()) {
             if (++attempts < 5) {
                 sched_yield();
@@ -85,9 +157,16 @@ public:
                 mach_wait_until(mach_absolute_time() + (wait_time * NSEC_PER_USEC));
             }
         }
+#endif
     }
     inline void unlock() {
+#ifdef __linux__
+        // wake exactly one parked waiter, if there may be any
+        if (_atomic.exchange(0, std::memory_order_release) == 2)
+            atomic_futex_wake(&_atomic, 1);
+#else
         _atomic.store(0, std::memory_order_release);
+#endif
     }
     inline std::atomic<int> *P() {
         return &_atomic;
@@ -97,6 +176,9 @@ protected:
     
     std::atomic<int> _atomic;
     double timer;
+#ifdef __linux__
+    std::atomic<int> _spin{0};     // running average of spins needed to get the lock
+#endif
 };
 
 class StAtomicLock
@@ -117,6 +199,7 @@ protected:
     AtomicLock *_lock;
 };
 
+#ifndef __linux__
 class DiagnosticAtomicLock : public AtomicLock {
 private:
     std::atomic<uint64_t> total_lock_time{0};
@@ -158,6 +241,7 @@ protected:
         return (double)nanos / 1e9;
     }
 };
+#endif
 
 class AdvancedAtomicLock : public AtomicLock {
 private:
@@ -216,6 +300,62 @@ public:
         return 0;
     }
     
+#ifdef __linux__
+    // _count is the semaphore value, waiters sleep on it while it is 0
+    inline int signal() {
+        // seq_cst pairs with the waiters count, a waiter either sees the new value or gets woken
+        _count.fetch_add(1, std::memory_order_seq_cst);
+        if (_waiters.load(std::memory_order_seq_cst))
+            atomic_futex_wake(&_count, 1);
+        return 0;
+    }
+    inline int wait(uint64_t timeout_ns) {
+        uint64_t deadline = atomic_now_ns() + timeout_ns;
+        
+        for (int attempts = 0; ; attempts++) {
+            if (trywait() == 0)
+                return 0;
+            
+            uint64_t now = atomic_now_ns();
+            if (now >= deadline)
+                return -1; // Timeout
+            
+            if (attempts < ATOMIC_SPIN_MIN) {
+                atomic_cpu_relax();
+                continue;
+            }
+            
+            uint64_t left = deadline - now;
+            struct timespec ts = { (time_t)(left / 1000000000ULL), (long)(left % 1000000000ULL) };
+            _waiters.fetch_add(1, std::memory_order_seq_cst);
+            atomic_futex_wait(&_count, 0, &ts);
+            _waiters.fetch_sub(1, std::memory_order_release);
+        }
+    }
+    inline int wait() {
+        for (int attempts = 0; ; attempts++) {
+            if (trywait() == 0)
+                return 0;
+            
+            if (attempts < ATOMIC_SPIN_MIN) {
+                atomic_cpu_relax();
+                continue;
+            }
+            
+            _waiters.fetch_add(1, std::memory_order_seq_cst);
+            atomic_futex_wait(&_count, 0, NULL);
+            _waiters.fetch_sub(1, std::memory_order_release);
+        }
+    }
+    inline int trywait() {
+        int c = _count.load(std::memory_order_relaxed);
+        while (c > 0) {
+            if (_count.compare_exchange_weak(c, c - 1, std::memory_order_acquire, std::memory_order_relaxed))
+                return 0;
+        }
+        return -1;
+    }
+#else
     inline int signal() {
         int prev = _count.fetch_add(1, std::memory_order_release);
         if (prev == 0) {
@@ -279,11 +419,15 @@ public:
         int expected = 1;
         return _count.compare_exchange_strong(expected, 0, std::memory_order_acquire) ? 0 : -1;
     }
+#endif
     
 protected:
     std::mutex              _mutex;
     std::atomic<int>        _count;
     std::condition_variable _cond;
+#ifdef __linux__
+    std::atomic<int>        _waiters{0};
+#endif
 };
  
 #endif // __cplusplus
@@ -0,0 +1,392 @@
+//  bench.cpp - FreedomPool allocator benchmarks
+//
+//  Runs the classic allocator workloads against FreedomPool and the system malloc side by side:
+//  larson, threadtest, xmalloc-test, cache-scratch, random size churn and realloc growth.
+//  Every run (workload x allocator x thread count) happens in its own forked process, so the
+//  peak RSS reported is that run's alone. Build with the Makefile next to this file:
+//  bench_static uses the FREEDOM_STACK_ALLOC model, bench_dynamic the reserve/commit one.
+//
+//  usage: bench [-t max_threads] [-s scale] [-w workload] [-a freedom|system]
+
+#include "freedom_pool.h"
+
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <stdlib.h>
+#include <thread>
+#include <vector>
+#include <random>
+
+
+struct Allocator {
+    const char* name;
+    void* (*malloc)(size_t);
+    void  (*free)(void*);
+    void* (*realloc)(void*, size_t);
+};
+
+static void* pool_malloc(size_t n) { return bigpool.malloc(n); }
+static void  pool_free(void* p) { bigpool.free(p); }
+static void* pool_realloc(void* p, size_t n) { return bigpool.realloc(p, n); }
+
+static const Allocator allocators[] = {
+    { "freedom", pool_malloc, pool_free, pool_realloc },
+    { "system", ::malloc, ::free, ::realloc },
+};
+
+#define SAMPLE_EVERY    16          // one op in SAMPLE_EVERY is timed for the latency percentiles
+
+static __inline uint64_t now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// Per thread view of the allocator under test, counts the ops and samples their latency
+struct Worker {
+    const Allocator* a;
+    uint64_t ops;
+    unsigned tick;
+    std::vector<uint32_t> samples;
+
+    explicit Worker(const Allocator* alloc) : a(alloc), ops(0), tick(0) { samples.reserve(1 << 16); }
+
+    __inline void* malloc(size_t n)
+    {
+        ops++;
+        if (++tick % SAMPLE_EVERY)
+            return a->malloc(n);
+        uint64_t start = now_ns();
+        void* p = a->malloc(n);
+        samples.push_back((uint32_t)std::min(now_ns() - start, (uint64_t)UINT32_MAX));
+        return p;
+    }
+    __inline void free(void* p)
+    {
+        ops++;
+        if (++tick % SAMPLE_EVERY) {
+            a->free(p);
+            return;
+        }
+        uint64_t start = now_ns();
+        a->free(p);
+        samples.push_back((uint32_t)std::min(now_ns() - start, (uint64_t)UINT32_MAX));
+    }
+    __inline void* realloc(void* p, size_t n)
+    {
+        ops++;
+        if (++tick % SAMPLE_EVERY)
+            return a->realloc(p, n);
+        uint64_t start = now_ns();
+        void* q = a->realloc(p, n);
+        samples.push_back((uint32_t)std::min(now_ns() - start, (uint64_t)UINT32_MAX));
+        return q;
+    }
+};
+
+static __inline void touch(void* p, size_t n)
+{
+    ((volatile char*)p)[0] = 1;
+    ((volatile char*)p)[n - 1] = 1;
+}
+
+// Run body(worker, thread index) on count threads
+template <class F> static void run_threads(std::vector<Worker>& workers, F body)
+{
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < workers.size(); i++)
+        threads.emplace_back([&, i] { body(workers[i], i); });
+    for (auto& t : threads)
+        t.join();
+}
+
+// larson: server threads replace random objects of their set, the set then passes to another
+// thread, so most frees are of memory another thread allocated
+static void larson(std::vector<Worker>& w, size_t scale)
+{
+    const size_t slots = 1000, rounds = 8, ops = 20000 * scale;
+    size_t nt = w.size();
+    std::vector<std::vector<void*>> sets(nt, std::vector<void*>(slots, nullptr));
+
+    for (size_t round = 0; round < rounds; round++) {
+        run_threads(w, [&](Worker& k, size_t t) {
+            std::vector<void*>& set = sets[(t + round) % nt];
+            std::mt19937 r((unsigned)(t * 7919 + round));
+            for (size_t i = 0; i < ops; i++) {
+                size_t j = r() % slots;
+                if (set[j])
+                    k.free(set[j]);
+                size_t n = r() % 500 + 10;
+                set[j] = k.malloc(n);
+                touch(set[j], n);
+            }
+        });
+    }
+    for (auto& set : sets) {
+        for (void* p : set) {
+            if (p)
+                w[0].free(p);
+        }
+    }
+}
+
+// threadtest: every thread allocates a batch of same-sized objects and frees them all, repeatedly
+static void threadtest(std::vector<Worker>& w, size_t scale)
+{
+    const size_t batch = 1000, iterations = 100 * scale;
+    run_threads(w, [&](Worker& k, size_t) {
+        std::vector<void*> objs(batch);
+        for (size_t it = 0; it < iterations; it++) {
+            for (size_t i = 0; i < batch; i++) {
+                objs[i] = k.malloc(64);
+                touch(objs[i], 64);
+            }
+            for (size_t i = 0; i < batch; i++)
+                k.free(objs[i]);
+        }
+    });
+}
+
+// xmalloc-test: producers allocate, consumers free what they are handed through a ring
+static void xmalloc_test(std::vector<Worker>& w, size_t scale)
+{
+    const size_t ring = 1024, count = 100000 * scale;
+    size_t pairs = std::max(w.size() / 2, (size_t)1);
+
+    struct alignas(64) Ring {
+        std::atomic<size_t> head{0}, tail{0};
+        void* slots[1024];
+    };
+    std::vector<Ring> rings(pairs);
+
+    run_threads(w, [&](Worker& k, size_t t) {
+        std::mt19937 r((unsigned)t);
+        if (w.size() == 1) {
+            // a lone thread plays both roles
+            for (size_t i = 0; i < count; i++) {
+                size_t n = r() % 256 + 8;
+                void* p = k.malloc(n);
+                touch(p, n);
+                k.free(p);
+            }
+            return;
+        }
+        if (t >= pairs * 2)
+            return;
+        Ring& q = rings[t / 2];
+        if (t % 2 == 0) {
+            for (size_t i = 0; i < count; i++) {
+                size_t n = r() % 256 + 8;
+                void* p = k.malloc(n);
+                touch(p, n);
+                size_t head = q.head.load(std::memory_order_relaxed);
+                while (head - q.tail.load(std::memory_order_acquire) == ring)
+                    std::this_thread::yield();
+                q.slots[head % ring] = p;
+                q.head.store(head + 1, std::memory_order_release);
+            }
+        } else {
+            for (size_t i = 0; i < count; i++) {
+                size_t tail = q.tail.load(std::memory_order_relaxed);
+                while (q.head.load(std::memory_order_acquire) == tail)
+                    std::this_thread::yield();
+                k.free(q.slots[tail % ring]);
+                q.tail.store(tail + 1, std::memory_order_release);
+            }
+        }
+    });
+}
+
+// cache-scratch: each thread frees an object the main thread allocated next to the others'
+// objects, then keeps allocating, writing and freeing small objects. An allocator that hands
+// the freed neighbours back to different threads shows false sharing here
+static void cache_scratch(std::vector<Worker>& w, size_t scale)
+{
+    const size_t iterations = 50000 * scale, writes = 50;
+    std::vector<void*> initial(w.size());
+    for (size_t t = 0; t < w.size(); t++)
+        initial[t] = w[0].malloc(8);
+
+    run_threads(w, [&](Worker& k, size_t t) {
+        k.free(initial[t]);
+        for (size_t i = 0; i < iterations; i++) {
+            volatile char* p = (volatile char*)k.malloc(8);
+            for (size_t j = 0; j < writes; j++)
+                p[j % 8]++;
+            k.free((void*)p);
+        }
+    });
+}
+
+// random size churn: objects from 16 bytes to 64 KB, two allocs for each free
+// until the working set reaches its cap, then it churns around that size
+static void churn(std::vector<Worker>& w, size_t scale)
+{
+    const size_t ops = 200000 * scale, working_set = 2000;
+    run_threads(w, [&](Worker& k, size_t t) {
+        std::vector<void*> live;
+        live.reserve(working_set);
+        std::mt19937 r((unsigned)t + 1);
+        for (size_t i = 0; i < ops; i++) {
+            if (live.empty() || (live.size() < working_set && r() % 3)) {
+                size_t n = (size_t)16 << (r() % 12);
+                n += r() % n;
+                void* p = k.malloc(n);
+                touch(p, n);
+                live.push_back(p);
+            } else {
+                size_t j = r() % live.size();
+                k.free(live[j]);
+                live[j] = live.back();
+                live.pop_back();
+            }
+        }
+        for (void* p : live)
+            k.free(p);
+    });
+}
+
+// realloc growth: buffers grown by half again from 16 bytes to 1 MB, with small allocations in between
+static void realloc_growth(std::vector<Worker>& w, size_t scale)
+{
+    const size_t buffers = 200 * scale;
+    run_threads(w, [&](Worker& k, size_t) {
+        for (size_t b = 0; b < buffers; b++) {
+            void* p = NULL;
+            void* noise[8];
+            size_t count = 0;
+            for (size_t n = 16; n <= MBYTE; n += n / 2) {
+                p = k.realloc(p, n);
+                touch(p, n);
+                if (count < 8)
+                    noise[count++] = k.malloc(n / 8 + 1);
+            }
+            k.free(p);
+            while (count)
+                k.free(noise[--count]);
+        }
+    });
+}
+
+struct Workload {
+    const char* name;
+    void (*run)(std::vector<Worker>&, size_t);
+};
+
+static const Workload workloads[] = {
+    { "larson", larson },
+    { "threadtest", threadtest },
+    { "xmalloc-test", xmalloc_test },
+    { "cache-scratch", cache_scratch },
+    { "churn", churn },
+    { "realloc-growth", realloc_growth },
+};
+
+struct Result {
+    double ops_per_sec;
+    double p50, p99, p999;          // sampled per-op latency, ns
+};
+
+static Result measure(const Workload& wl, const Allocator& a, size_t threads, size_t scale)
+{
+    std::vector<Worker> workers(threads, Worker(&a));
+
+    uint64_t start = now_ns();
+    wl.run(workers, scale);
+    uint64_t elapsed = now_ns() - start;
+
+    uint64_t ops = 0;
+    std::vector<uint32_t> samples;
+    for (auto& k : workers) {
+        ops += k.ops;
+        samples.insert(samples.end(), k.samples.begin(), k.samples.end());
+    }
+    std::sort(samples.begin(), samples.end());
+
+    Result res;
+    res.ops_per_sec = ops * 1e9 / std::max(elapsed, (uint64_t)1);
+    res.p50 = samples.empty() ? 0 : samples[samples.size() / 2];
+    res.p99 = samples.empty() ? 0 : samples[samples.size() * 99 / 100];
+    res.p999 = samples.empty() ? 0 : samples[samples.size() * 999 / 1000];
+    return res;
+}
+
+// Run one measurement in a child process, its peak RSS comes back from wait4
+static bool run_forked(const Workload& wl, const Allocator& a, size_t threads, size_t scale, Result& res, long& rss_kb)
+{
+    int fds[2];
+    if (pipe(fds))
+        return false;
+
+    pid_t pid = fork();
+    if (pid < 0)
+        return false;
+    if (pid == 0) {
+        close(fds[0]);
+        Result r = measure(wl, a, threads, scale);
+        ssize_t written = write(fds[1], &r, sizeof(r));
+        _exit(written == (ssize_t)sizeof(r) ? 0 : 1);
+    }
+
+    close(fds[1]);
+    ssize_t got = read(fds[0], &res, sizeof(res));
+    close(fds[0]);
+
+    int status;
+    struct rusage usage;
+    if (wait4(pid, &status, 0, &usage) != pid || !WIFEXITED(status) || WEXITSTATUS(status) || got != (ssize_t)sizeof(res))
+        return false;
+    rss_kb = usage.ru_maxrss;
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    size_t max_threads = std::max(std::thread::hardware_concurrency(), 1u);
+    size_t scale = 1;
+    const char* only_workload = NULL;
+    const char* only_allocator = NULL;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "t:s:w:a:")) != -1) {
+        switch (opt) {
+            case 't': max_threads = std::max(atoi(optarg), 1); break;
+            case 's': scale = std::max(atoi(optarg), 1); break;
+            case 'w': only_workload = optarg; break;
+            case 'a': only_allocator = optarg; break;
+            default:
+                fprintf(stderr, "usage: %s [-t max_threads] [-s scale] [-w workload] [-a freedom|system]\n", argv[0]);
+                return 1;
+        }
+    }
+
+#ifdef FREEDOM_STACK_ALLOC
+    const char* model = "static";
+#else
+    const char* model = "dynamic";
+#endif
+    printf("%-15s %-8s %-8s %7s %14s %9s %9s %9s %10s\n", "workload", "alloc", "model", "threads", "ops/sec", "p50 ns", "p99 ns", "p99.9 ns", "peak RSS");
+
+    for (const Workload& wl : workloads) {
+        if (only_workload && strcmp(only_workload, wl.name))
+            continue;
+        for (size_t threads = 1; ; threads = std::min(threads * 2, max_threads)) {
+            for (const Allocator& a : allocators) {
+                if (only_allocator && strcmp(only_allocator, a.name))
+                    continue;
+                Result res;
+                long rss_kb;
+                if (!run_forked(wl, a, threads, scale, res, rss_kb)) {
+                    printf("%-15s %-8s %-8s %7zu   failed\n", wl.name, a.name, model, threads);
+                    continue;
+                }
+                printf("%-15s %-8s %-8s %7zu %14.0f %9.0f %9.0f %9.0f %7ld MB\n", wl.name, a.name, model, threads,
+                       res.ops_per_sec, res.p50, res.p99, res.p999, rss_kb / 1024);
+            }
+            if (threads == max_threads)
+                break;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,259 @@
+//  placement.cpp - compare FreedomPool placement policies
+//
+//  Runs fragmentation-prone workloads single threaded against one static-model pool per placement
+//  policy (good fit, bounded fit, best fit, first fit, next fit), each run in its own forked process.
+//  Sizes stay above SLAB_MAX_SIZE so every request goes through the placement search. Reported are
+//  ops/sec, allocations that failed in the fixed-size pool, the address span of the live set,
+//  free block count and fragmentation (1 - largest free block / free bytes) at the end of the run.
+//
+//  usage: placement [-s scale] [-w workload] [-p policy]
+
+#include "freedom_pool.h"
+
+#include <sys/wait.h>
+#include <stdlib.h>
+#include <vector>
+#include <random>
+
+#ifndef PLACEMENT_POOL_SIZE
+#define PLACEMENT_POOL_SIZE     (128 * MBYTE)
+#endif
+
+struct Live {
+    void* p;
+    size_t size;
+};
+
+struct Result {
+    double ops_per_sec;
+    size_t failed;
+    size_t span;                // from the lowest live byte to the highest
+    size_t in_use;
+    size_t free_blocks;
+    double fragmentation;
+};
+
+static __inline uint64_t now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// Log-uniform size in [lo, hi)
+static __inline size_t log_size(std::mt19937& r, size_t lo, size_t hi)
+{
+    return (size_t)(lo * pow((double)hi / lo, (r() & 0xffffff) / (double)0x1000000));
+}
+
+// The pool under test and the live set, tallies ops and failures
+template <typename Pool> struct Driver {
+    Pool& pool;
+    std::vector<Live> live;
+    uint64_t ops = 0;
+    size_t failed = 0;
+
+    explicit Driver(Pool& p) : pool(p) {}
+
+    __inline bool alloc(size_t size)
+    {
+        ops++;
+        void* p = pool.malloc(size);
+        if (!p) {
+            failed++;
+            return false;
+        }
+        ((volatile char*)p)[0] = 1;
+        live.push_back(Live{ p, size });
+        return true;
+    }
+    __inline void release(size_t i)
+    {
+        ops++;
+        pool.free(live[i].p);
+        live[i] = live.back();
+        live.pop_back();
+    }
+};
+
+// long-lived: a heap of 4 to 64 KB objects kept at about 60% of the pool, a random one replaced per step
+template <typename Pool> static void long_lived(Driver<Pool>& d, size_t scale)
+{
+    std::mt19937 r(1);
+    size_t target = PLACEMENT_POOL_SIZE / 10 * 6, bytes = 0;
+    for (size_t i = 0; i < 400000 * scale; i++) {
+        if (bytes < target) {
+            size_t n = log_size(r, 4 * KBYTE, 64 * KBYTE);
+            if (d.alloc(n))
+                bytes += n;
+        } else {
+            size_t j = r() % d.live.size();
+            bytes -= d.live[j].size;
+            d.release(j);
+        }
+    }
+}
+
+// streaming: a FIFO of 32 to 96 KB buffers, 64 in flight, the oldest goes when a new one comes
+template <typename Pool> static void streaming(Driver<Pool>& d, size_t scale)
+{
+    std::mt19937 r(2);
+    std::vector<Live> ring(64, Live{ NULL, 0 });
+    for (size_t i = 0; i < 400000 * scale; i++) {
+        Live& slot = ring[i % ring.size()];
+        if (slot.p) {
+            d.ops++;
+            d.pool.free(slot.p);
+            slot.p = NULL;
+        }
+        if (d.alloc(32 * KBYTE + r() % (64 * KBYTE))) {
+            slot = d.live.back();
+            d.live.pop_back();
+        }
+    }
+    for (Live& slot : ring) {
+        if (slot.p)
+            d.live.push_back(slot);
+    }
+}
+
+// mixed: most objects of 3 to 16 KB die within a few steps, one in eight lives for a long time
+template <typename Pool> static void mixed(Driver<Pool>& d, size_t scale)
+{
+    std::mt19937 r(3);
+    std::vector<Live> young;
+    size_t old_cap = PLACEMENT_POOL_SIZE / (16 * KBYTE);
+    for (size_t i = 0; i < 600000 * scale; i++) {
+        if (!d.alloc(log_size(r, 3 * KBYTE, 16 * KBYTE)))
+            continue;
+        if (r() % 8) {
+            young.push_back(d.live.back());
+            d.live.pop_back();
+        }
+        if (young.size() > 16) {
+            size_t j = r() % young.size();
+            d.ops++;
+            d.pool.free(young[j].p);
+            young[j] = young.back();
+            young.pop_back();
+        }
+        if (d.live.size() > old_cap)
+            d.release(r() % d.live.size());
+    }
+    d.live.insert(d.live.end(), young.begin(), young.end());
+}
+
+struct Workload {
+    const char* name;
+    int id;
+};
+
+static const Workload workloads[] = {
+    { "long-lived", 0 },
+    { "streaming", 1 },
+    { "mixed", 2 },
+};
+
+template <typename Policy> static Result measure(int workload, size_t scale)
+{
+    static FreedomPool<PLACEMENT_POOL_SIZE, Policy> pool;
+    Driver<FreedomPool<PLACEMENT_POOL_SIZE, Policy>> d(pool);
+
+    uint64_t start = now_ns();
+    switch (workload) {
+        case 0: long_lived(d, scale); break;
+        case 1: streaming(d, scale); break;
+        case 2: mixed(d, scale); break;
+    }
+    uint64_t elapsed = now_ns() - start;
+
+    Result res;
+    uintptr_t lo = UINTPTR_MAX, hi = 0;
+    for (const Live& l : d.live) {
+        lo = std::min(lo, (uintptr_t)l.p);
+        hi = std::max(hi, (uintptr_t)l.p + l.size);
+    }
+    FreedomStats stats = pool.GetStats();
+    res.ops_per_sec = d.ops * 1e9 / std::max(elapsed, (uint64_t)1);
+    res.failed = d.failed;
+    res.span = hi > lo ? hi - lo : 0;
+    res.in_use = stats.in_use;
+    res.free_blocks = stats.free_blocks;
+    res.fragmentation = stats.fragmentation;
+    return res;
+}
+
+struct Policy {
+    const char* name;
+    Result (*measure)(int, size_t);
+};
+
+static const Policy policies[] = {
+    { "good", measure<PlacementGoodFit> },
+    { "bounded", measure<PlacementBoundedFit> },
+    { "best", measure<PlacementBestFit> },
+    { "first", measure<PlacementFirstFit> },
+    { "next", measure<PlacementNextFit> },
+};
+
+// Each run gets a fresh pool in its own child process
+static bool run_forked(const Workload& wl, const Policy& policy, size_t scale, Result& res)
+{
+    int fds[2];
+    if (pipe(fds))
+        return false;
+
+    pid_t pid = fork();
+    if (pid < 0)
+        return false;
+    if (pid == 0) {
+        close(fds[0]);
+        Result r = policy.measure(wl.id, scale);
+        ssize_t written = write(fds[1], &r, sizeof(r));
+        _exit(written == (ssize_t)sizeof(r) ? 0 : 1);
+    }
+
+    close(fds[1]);
+    ssize_t got = read(fds[0], &res, sizeof(res));
+    close(fds[0]);
+
+    int status;
+    return waitpid(pid, &status, 0) == pid && WIFEXITED(status) && !WEXITSTATUS(status) && got == (ssize_t)sizeof(res);
+}
+
+int main(int argc, char** argv)
+{
+    size_t scale = 1;
+    const char* only_workload = NULL;
+    const char* only_policy = NULL;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "s:w:p:")) != -1) {
+        switch (opt) {
+            case 's': scale = std::max(atoi(optarg), 1); break;
+            case 'w': only_workload = optarg; break;
+            case 'p': only_policy = optarg; break;
+            default:
+                fprintf(stderr, "usage: %s [-s scale] [-w workload] [-p good|bounded|best|first|next]\n", argv[0]);
+                return 1;
+        }
+    }
+
+    printf("%-12s %-8s %14s %8s %10s %10s %11s %7s\n", "workload", "policy", "ops/sec", "failed", "span MB", "in use MB", "free blocks", "frag %");
+    for (const Workload& wl : workloads) {
+        if (only_workload && strcmp(only_workload, wl.name))
+            continue;
+        for (const Policy& policy : policies) {
+            if (only_policy && strcmp(only_policy, policy.name))
+                continue;
+            Result res;
+            if (!run_forked(wl, policy, scale, res)) {
+                printf("%-12s %-8s   failed\n", wl.name, policy.name);
+                continue;
+            }
+            printf("%-12s %-8s %14.0f %8zu %10.1f %10.1f %11zu %7.1f\n", wl.name, policy.name, res.ops_per_sec, res.failed,
+                   res.span / (double)MBYTE, res.in_use / (double)MBYTE, res.free_blocks, res.fragmentation * 100.0);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,142 @@
+//  replay.cpp - play an allocation trace back against a FreedomPool
+//
+//  Record a trace by building freedom_pool.cpp with FREEDOM_TRACE and running the program with
+//  FREEDOM_TRACE_FILE=trace.bin. The records of all threads are merged by timestamp and replayed
+//  on one thread against a pool built with this file's flags, so the same trace can be tried
+//  against other MEMORY_ALIGNMENT, size class or pool size settings (see REPLAY_FLAGS in the Makefile).
+//
+//  usage: replay [-i samples] trace.bin
+
+#include "freedom_pool.h"
+
+#include <sys/stat.h>
+#include <stdlib.h>
+#include <vector>
+#include <unordered_map>
+
+#ifndef REPLAY_POOL_SIZE
+#define REPLAY_POOL_SIZE DEFAULT_GROW
+#endif
+
+static FreedomPool<REPLAY_POOL_SIZE> pool;
+
+static __inline uint64_t now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// Pool footprint: committed pool memory in use plus the huge mappings
+static __inline size_t footprint(const FreedomStats& stats)
+{
+    return stats.pool_size - stats.free_size + stats.huge_size;
+}
+
+int main(int argc, char** argv)
+{
+    size_t intervals = 20;
+    int opt;
+    while ((opt = getopt(argc, argv, "i:")) != -1) {
+        if (opt != 'i') {
+            fprintf(stderr, "usage: %s [-i samples] trace.bin\n", argv[0]);
+            return 1;
+        }
+        intervals = std::max(atoi(optarg), 1);
+    }
+    if (optind >= argc) {
+        fprintf(stderr, "usage: %s [-i samples] trace.bin\n", argv[0]);
+        return 1;
+    }
+
+    int fd = open(argv[optind], O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) || st.st_size < 8) {
+        fprintf(stderr, "replay: can't read %s\n", argv[optind]);
+        return 1;
+    }
+    const char* data = (const char*)mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED || memcmp(data, TRACE_MAGIC, 8)) {
+        fprintf(stderr, "replay: %s is not a FreedomPool trace\n", argv[optind]);
+        return 1;
+    }
+
+    // threads flush whole buffers, merge them back into call order
+    size_t count = (st.st_size - 8) / sizeof(TraceRecord);
+    std::vector<TraceRecord> trace((const TraceRecord*)(data + 8), (const TraceRecord*)(data + 8) + count);
+    std::stable_sort(trace.begin(), trace.end(), [](const TraceRecord& a, const TraceRecord& b) { return a.time < b.time; });
+
+    uint32_t threads = 0;
+    for (const TraceRecord& r : trace)
+        threads = std::max(threads, r.thread + 1);
+    // the knobs REPLAY_FLAGS may have changed, so a run always says what it measured
+    printf("pool %zu MB, MEMORY_ALIGNMENT %d, TLSF_SL_LOG2 %d, SLAB_MAX_SIZE %d, %d slab classes, %s\n",
+           (size_t)REPLAY_POOL_SIZE / MBYTE, MEMORY_ALIGNMENT, TLSF_SL_LOG2, SLAB_MAX_SIZE, SLAB_CLASS_COUNT,
+#ifdef FREEDOM_STACK_ALLOC
+           "static model");
+#else
+           "dynamic model");
+#endif
+    printf("%zu records from %u threads over %.3f s\n", count, threads, count ? trace.back().time / 1e9 : 0.0);
+    printf("%12s %10s %12s %12s %12s %10s %8s\n", "ops", "trace s", "in use kb", "footprint kb", "free blocks", "largest kb", "frag %");
+
+    // traced addresses to the replayed allocations, frees of pointers from before the trace are skipped
+    std::unordered_map<uint64_t, void*> live;
+    live.reserve(count / 2 + 1);
+
+    size_t step = std::max(count / intervals, (size_t)1);
+    size_t peak = 0, skipped = 0, failed = 0;
+    uint64_t elapsed = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        const TraceRecord& r = trace[i];
+        void* p = NULL;
+        void* old = NULL;
+
+        if (r.op == TRACE_FREE || r.op == TRACE_DELETE || r.op == TRACE_REALLOC) {
+            uint64_t key = r.op == TRACE_REALLOC ? r.old : r.ptr;
+            if (key) {
+                auto it = live.find(key);
+                if (it == live.end()) {
+                    skipped++;
+                    continue;
+                }
+                old = it->second;
+                live.erase(it);
+            }
+        }
+
+        uint64_t start = now_ns();
+        switch (r.op) {
+            case TRACE_MALLOC:
+            case TRACE_NEW:     p = pool.malloc(r.size); break;
+            case TRACE_CALLOC:  p = pool.calloc(1, r.size); break;
+            case TRACE_MEMALIGN: p = pool.memalign(r.old, r.size); break;
+            case TRACE_REALLOC: p = pool.realloc(old, r.size); break;
+            case TRACE_FREE:
+            case TRACE_DELETE:  pool.free(old); break;
+        }
+        elapsed += now_ns() - start;
+
+        if (r.op != TRACE_FREE && r.op != TRACE_DELETE) {
+            if (p && r.ptr)
+                live[r.ptr] = p;
+            else if (!p && r.ptr)
+                failed++;
+        }
+
+        if ((i + 1) % step == 0 || i + 1 == count) {
+            FreedomStats stats = pool.GetStats();
+            peak = std::max(peak, footprint(stats));
+            printf("%12zu %10.3f %12zu %12zu %12zu %10zu %8.1f\n", i + 1, r.time / 1e9, stats.in_use / KBYTE,
+                   footprint(stats) / KBYTE, stats.free_blocks, stats.largest_free / KBYTE, stats.fragmentation * 100.0);
+        }
+    }
+
+    FreedomStats stats = pool.GetStats();
+    printf("replayed %zu ops in %.3f ms: %.0f ops/sec\n", count - skipped, elapsed / 1e6, (count - skipped) * 1e9 / std::max(elapsed, (uint64_t)1));
+    printf("peak footprint %zu kb (sampled), pool high-water mark %zu kb, %zu frees of unknown pointers skipped, %zu allocations failed\n",
+           peak / KBYTE, stats.peak / KBYTE, skipped, failed);
+    return 0;
+}
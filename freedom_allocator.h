@@ -0,0 +1,128 @@
+//  freedom_allocator.h - standard allocator and std::pmr::memory_resource over a FreedomPool instance
+//
+//  The new/delete overrides send every container to bigpool. FreedomAllocator<T, Pool> and
+//  FreedomMemoryResource<poolsize> let a container draw from a dedicated pool instead:
+//
+//      static FreedomPool<64 * MBYTE> sessions;
+//      std::vector<int, FreedomAllocator<int, FreedomPool<64 * MBYTE>>> v(FreedomAllocator<int, FreedomPool<64 * MBYTE>>(sessions));
+//
+//      FreedomMemoryResource<64 * MBYTE> resource(sessions);
+//      std::pmr::unordered_map<int, std::pmr::string> m(&resource);
+//
+//  Both pass the size and alignment through: over-aligned types go to memalign(), and deallocation
+//  uses free_sized(), which puts small slots back in the thread cache without reading their slab header.
+
+#pragma once
+
+#include "freedom_pool.h"
+
+#include <new>
+#include <type_traits>
+
+#if __has_include(<memory_resource>)
+#include <memory_resource>
+#endif
+
+// Allocation failure: std::bad_alloc as the allocator requirements ask, NULL without exceptions
+#if defined(__cpp_exceptions) || defined(__EXCEPTIONS)
+#define FREEDOM_BAD_ALLOC()     throw std::bad_alloc()
+#else
+#define FREEDOM_BAD_ALLOC()     return NULL
+#endif
+
+template <typename T, typename Pool = FreedomPool<DEFAULT_GROW>>
+class FreedomAllocator
+{
+    template <typename U, typename P> friend class FreedomAllocator;
+
+public:
+    typedef T value_type;
+    typedef size_t size_type;
+    typedef ptrdiff_t difference_type;
+
+    // The pool goes with the container's elements, two allocators are equal when they share it
+    typedef std::true_type propagate_on_container_copy_assignment;
+    typedef std::true_type propagate_on_container_move_assignment;
+    typedef std::true_type propagate_on_container_swap;
+    typedef std::false_type is_always_equal;
+
+    template <typename U>
+    struct rebind {
+        typedef FreedomAllocator<U, Pool> other;
+    };
+
+    // Default to the process wide pool, only available when Pool is its type
+    FreedomAllocator() noexcept : m_Pool(&bigpool) {}
+    FreedomAllocator(Pool& pool) noexcept : m_Pool(&pool) {}
+
+    template <typename U>
+    FreedomAllocator(const FreedomAllocator<U, Pool>& other) noexcept : m_Pool(other.m_Pool) {}
+
+    T *_Nonnull allocate(size_t n)
+    {
+        if (n > (size_t)-1 / sizeof(T))
+            FREEDOM_BAD_ALLOC();
+        void *p = alignof(T) > MEMORY_ALIGNMENT ? m_Pool->memalign(alignof(T), n * sizeof(T)) : m_Pool->malloc(n * sizeof(T));
+        if (!p)
+            FREEDOM_BAD_ALLOC();
+        return (T*)p;
+    }
+
+    __inline void deallocate(T *_Nullable p, size_t n) noexcept
+    {
+        m_Pool->free_sized(p, n * sizeof(T));
+    }
+
+    __inline Pool& GetPool() const noexcept { return *m_Pool; }
+
+    template <typename U>
+    __inline bool operator==(const FreedomAllocator<U, Pool>& other) const noexcept { return m_Pool == other.m_Pool; }
+    template <typename U>
+    __inline bool operator!=(const FreedomAllocator<U, Pool>& other) const noexcept { return m_Pool != other.m_Pool; }
+
+private:
+    Pool *_Nonnull m_Pool;
+};
+
+#ifdef __cpp_lib_memory_resource
+
+template <size_t poolsize = DEFAULT_GROW, typename Placement = FREEDOM_PLACEMENT>
+class FreedomMemoryResource : public std::pmr::memory_resource
+{
+public:
+    FreedomMemoryResource(FreedomPool<poolsize, Placement>& pool = bigpool) noexcept : m_Pool(pool) {}
+
+    __inline FreedomPool<poolsize, Placement>& GetPool() const noexcept { return m_Pool; }
+
+protected:
+    void *_Nonnull do_allocate(size_t bytes, size_t alignment) override
+    {
+        void *p = alignment > MEMORY_ALIGNMENT ? m_Pool.memalign(alignment, bytes) : m_Pool.malloc(bytes);
+        if (!p)
+            FREEDOM_BAD_ALLOC();
+        return p;
+    }
+
+    void do_deallocate(void *_Nullable p, size_t bytes, size_t) override
+    {
+        m_Pool.free_sized(p, bytes);
+    }
+
+    // Resources over the same pool can free each other's memory
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override
+    {
+        if (this == &other)
+            return true;
+#if defined(__cpp_rtti) || defined(__GXX_RTTI)
+        const FreedomMemoryResource *resource = dynamic_cast<const FreedomMemoryResource*>(&other);
+        return resource && &resource->m_Pool == &m_Pool;
+#else
+        return false;
+#endif
+    }
+
+private:
+    FreedomPool<poolsize, Placement>& m_Pool;
+};
+
+#endif // __cpp_lib_memory_resource
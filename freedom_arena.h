@@ -0,0 +1,192 @@
+//  freedom_arena.h - scoped bump-pointer regions on top of FreedomPool
+//
+//  FreedomArena takes chunks from a FreedomPool (bigpool by default) and serves allocations by bumping a
+//  pointer: no block header, no lock, no search, and nothing to do on free. Everything goes at once with
+//  reset(), back to a mark() with rewind(), or when a FreedomArenaScope goes out of scope. Chunks are kept
+//  for the next frame, so a loop that resets every frame stops touching the pool after the first ones.
+//
+//      static thread_local FreedomArena<> frame;
+//      {
+//          FreedomArenaScope<> scope(frame);
+//          float *mix = frame.allocate_array<float>(frames * channels);
+//          ...
+//      }   // everything allocated in the scope is released here
+//
+//  An arena belongs to one thread at a time. Destructors of objects made with construct() do not run
+//  on reset/rewind, keep it to trivially destructible types or call them yourself.
+
+#pragma once
+
+#include "freedom_pool.h"
+
+#include <utility>
+
+#define ARENA_CHUNK_SIZE        (64 * KBYTE)                                // default chunk size
+
+template <size_t poolsize = DEFAULT_GROW, typename Placement = FREEDOM_PLACEMENT>
+class FreedomArena
+{
+    // Chunks are stacked, the current one on top, with their usable bytes after this header
+    struct Chunk {
+        Chunk *_Nullable    prev;
+        size_t              size;                                           // total, header included
+    };
+
+    static constexpr size_t ChunkHeader = ALIGN_UP(sizeof(Chunk), MEMORY_ALIGNMENT);
+
+public:
+    // A position in the arena, rewind() gives back everything allocated after it
+    struct Mark {
+        Chunk *_Nullable    chunk;
+        char *_Nullable     ptr;
+    };
+
+    FreedomArena(FreedomPool<poolsize, Placement>& pool = bigpool, size_t chunk_size = ARENA_CHUNK_SIZE):
+        m_Pool(pool),
+        m_ChunkSize(std::max(ALIGN_UP(chunk_size, MEMORY_ALIGNMENT), ChunkHeader + MEMORY_ALIGNMENT)),
+        m_Current(NULL),
+        m_Spare(NULL),
+        m_Ptr(NULL),
+        m_End(NULL),
+        m_Reserved(0)
+    {
+    }
+
+    ~FreedomArena()
+    {
+        Release();
+    }
+
+    FreedomArena(const FreedomArena&) = delete;
+    FreedomArena& operator=(const FreedomArena&) = delete;
+
+    // Bump allocation, alignment must be a power of two. NULL only when the pool can't give a new chunk
+    __inline void *_Nullable allocate(size_t size, size_t alignment = MEMORY_ALIGNMENT)
+    {
+        char *p = (char*)ALIGN_UP((uintptr_t)m_Ptr, alignment);
+        if (p < m_End && size <= (size_t)(m_End - p)) {
+            m_Ptr = p + size;
+            return p;
+        }
+        return Spill(size, alignment);
+    }
+
+    template <typename T>
+    __inline T *_Nullable allocate_array(size_t count)
+    {
+        if (count > (size_t)-1 / sizeof(T))
+            return NULL;
+        return (T*)allocate(count * sizeof(T), alignof(T));
+    }
+
+    template <typename T, typename... Args>
+    __inline T *_Nullable construct(Args&&... args)
+    {
+        void *p = allocate(sizeof(T), alignof(T));
+        return p ? new (p) T(std::forward<Args>(args)...) : NULL;
+    }
+
+    __inline Mark mark() const
+    {
+        return Mark{ m_Current, m_Ptr };
+    }
+
+    // Give back everything allocated since m. Chunks above it are kept for reuse, oversized ones go back to the pool
+    void rewind(const Mark& m)
+    {
+        while (m_Current != m.chunk) {
+            Chunk *chunk = m_Current;
+            m_Current = chunk->prev;
+            if (chunk->size > m_ChunkSize) {
+                m_Reserved -= chunk->size;
+                m_Pool.free(chunk);
+            } else {
+                chunk->prev = m_Spare;
+                m_Spare = chunk;
+            }
+        }
+        m_Ptr = m.ptr;
+        m_End = m_Current ? (char*)m_Current + m_Current->size : NULL;
+    }
+
+    __inline void reset()
+    {
+        rewind(Mark{ NULL, NULL });
+    }
+
+    // Reset and return all chunks, spare ones included, to the pool
+    void Release()
+    {
+        reset();
+        while (m_Spare) {
+            Chunk *chunk = m_Spare;
+            m_Spare = chunk->prev;
+            m_Pool.free(chunk);
+        }
+        m_Reserved = 0;
+    }
+
+    // Bytes held from the pool, in use or spare
+    __inline size_t GetReserved() const { return m_Reserved; }
+    __inline size_t GetChunkSize() const { return m_ChunkSize; }
+
+protected:
+    // The current chunk is full: continue in a spare chunk, or a new one sized for the request
+    void *_Nullable Spill(size_t size, size_t alignment)
+    {
+        if (size > (size_t)-1 / 2 || alignment > (size_t)-1 / 2)
+            return NULL;
+        size_t need = ChunkHeader + size + (alignment > MEMORY_ALIGNMENT ? alignment : 0);
+
+        Chunk *chunk = NULL;
+        if (m_Spare && need <= m_ChunkSize) {
+            chunk = m_Spare;
+            m_Spare = chunk->prev;
+        } else {
+            size_t chunk_size = std::max(m_ChunkSize, ALIGN_UP(need, MEMORY_ALIGNMENT));
+            chunk = (Chunk*)m_Pool.malloc(chunk_size);
+            if (!chunk)
+                return NULL;
+            chunk->size = chunk_size;
+            m_Reserved += chunk_size;
+        }
+        chunk->prev = m_Current;
+        m_Current = chunk;
+        m_Ptr = (char*)chunk + ChunkHeader;
+        m_End = (char*)chunk + chunk->size;
+        return allocate(size, alignment);
+    }
+
+private:
+    FreedomPool<poolsize, Placement>& m_Pool;   // where the chunks come from
+    size_t m_ChunkSize;
+    Chunk *_Nullable m_Current;                 // chunk being bumped, top of the stack
+    Chunk *_Nullable m_Spare;                   // rewound chunks, all m_ChunkSize
+    char *_Nullable m_Ptr;                      // next free byte of the current chunk
+    char *_Nullable m_End;
+    size_t m_Reserved;
+};
+
+// Marks the arena on construction and rewinds to the mark on destruction, scopes nest
+template <size_t poolsize = DEFAULT_GROW, typename Placement = FREEDOM_PLACEMENT>
+class FreedomArenaScope
+{
+public:
+    FreedomArenaScope(FreedomArena<poolsize, Placement>& arena):
+        m_Arena(arena),
+        m_Mark(arena.mark())
+    {
+    }
+
+    ~FreedomArenaScope()
+    {
+        m_Arena.rewind(m_Mark);
+    }
+
+    FreedomArenaScope(const FreedomArenaScope&) = delete;
+    FreedomArenaScope& operator=(const FreedomArenaScope&) = delete;
+
+private:
+    FreedomArena<poolsize, Placement>& m_Arena;
+    typename FreedomArena<poolsize, Placement>::Mark m_Mark;
+};
@@ -0,0 +1,314 @@
+//  freedom_object_pool.h - typed fixed-size object pool on top of FreedomPool
+//
+//  FreedomObjectPool<T, ChunkCount> carves chunks of ChunkCount slots out of a FreedomPool (bigpool by
+//  default) and hands out sizeof(T) slots, aligned for T, from an intrusive LIFO free list. No block
+//  header, no size class rounding and no search: construct() is a pop, destroy() a push. Slot size,
+//  alignment and the thread cache depth are all compile time constants of T.
+//
+//      static FreedomObjectPool<Order> orders;
+//      Order *order = orders.construct(id, price);
+//      orders.destroy(order);
+//
+//  Like FreedomPool's thread cache, a thread caches slots of the first pool of a type it uses, on a
+//  short per-thread list that is refilled and flushed in batches under the pool's lock. Caches go back
+//  at thread exit, so a pool used from several threads must outlive them (a static or global one).
+//  Objects still alive when the pool is destroyed are not destroyed, their memory goes back with the chunks.
+
+#pragma once
+
+#include "freedom_pool.h"
+
+#include <utility>
+
+#define OBJECT_POOL_CHUNK       256                                         // default slots per chunk
+#define OBJECT_CACHE_BYTES      (16 * KBYTE)                                // thread cache size, in slots of T
+#define OBJECT_CACHE_MIN        4
+#define OBJECT_CACHE_MAX        256
+
+template <typename T, size_t ChunkCount = OBJECT_POOL_CHUNK, bool UseThreadCache = true, size_t poolsize = DEFAULT_GROW,
+          typename Placement = FREEDOM_PLACEMENT>
+class FreedomObjectPool
+{
+    // A free slot holds the link to the next one in place of the object
+    struct Slot {
+        Slot *_Nullable next;
+    };
+
+    // Chunks are linked through their first slot-aligned bytes, so the pool can give them all back
+    struct Chunk {
+        Chunk *_Nullable next;
+    };
+
+public:
+    static constexpr size_t SlotAlign = alignof(T) > alignof(Slot) ? alignof(T) : alignof(Slot);
+    static constexpr size_t SlotSize = ALIGN_UP(sizeof(T) > sizeof(Slot) ? sizeof(T) : sizeof(Slot), SlotAlign);
+    static constexpr size_t ChunkHeader = ALIGN_UP(sizeof(Chunk), SlotAlign);
+    static constexpr size_t ChunkSize = ChunkHeader + ChunkCount * SlotSize;
+
+    // Thread cache depth, OBJECT_CACHE_BYTES worth of slots within OBJECT_CACHE_MIN..MAX, refilled half at a time
+    static constexpr size_t CacheDepth = std::min(std::max(OBJECT_CACHE_BYTES / SlotSize, (size_t)OBJECT_CACHE_MIN), (size_t)OBJECT_CACHE_MAX);
+    static constexpr size_t CacheBatch = CacheDepth / 2;
+
+    static_assert(ChunkCount > 0, "FreedomObjectPool needs at least one slot per chunk");
+
+    FreedomObjectPool(FreedomPool<poolsize, Placement>& pool = bigpool):
+        m_Pool(pool),
+        m_Chunks(NULL),
+        m_ChunkCount(0),
+        m_Free(NULL),
+        m_Bump(NULL),
+        m_BumpEnd(NULL),
+        m_Generation(NextGeneration())
+    {
+        m_Lock.init();
+#ifndef DISABLE_THREAD_CACHE
+        if (UseThreadCache)
+            pthread_key_create(&m_CacheKey, ReleaseThreadCache);
+#endif
+    }
+
+    ~FreedomObjectPool()
+    {
+#ifndef DISABLE_THREAD_CACHE
+        if (UseThreadCache) {
+            // the chunks go back as a whole, this thread's cached slots with them. Other threads'
+            // caches keep this pool's generation, a pool built here later drops them
+            ThreadCache& cache = GetThreadCache();
+            if (cache.owner == this && cache.generation == m_Generation) {
+                pthread_setspecific(m_CacheKey, NULL);
+                ResetThreadCache(cache);
+            }
+            pthread_key_delete(m_CacheKey);
+        }
+#endif
+        while (m_Chunks) {
+            Chunk *chunk = m_Chunks;
+            m_Chunks = chunk->next;
+            m_Pool.free(chunk);
+        }
+    }
+
+    FreedomObjectPool(const FreedomObjectPool&) = delete;
+    FreedomObjectPool& operator=(const FreedomObjectPool&) = delete;
+
+    // Allocate a slot and construct a T in it, NULL when the pool can't grow
+    template <typename... Args>
+    __inline T *_Nullable construct(Args&&... args)
+    {
+        void *slot = allocate();
+        if (!slot)
+            return NULL;
+#if defined(__cpp_exceptions) || defined(__EXCEPTIONS)
+        try {
+            return new (slot) T(std::forward<Args>(args)...);
+        } catch (...) {
+            deallocate(slot);
+            throw;
+        }
+#else
+        return new (slot) T(std::forward<Args>(args)...);
+#endif
+    }
+
+    __inline void destroy(T *_Nullable p)
+    {
+        if (!p)
+            return;
+        p->~T();
+        deallocate(p);
+    }
+
+    // Raw slots, for callers that construct in place themselves
+    __inline void *_Nullable allocate()
+    {
+#ifndef DISABLE_THREAD_CACHE
+        if (UseThreadCache) {
+            ThreadCache& cache = GetThreadCache();
+            if (BindThreadCache(cache)) {
+                if (!cache.head && !RefillThreadCache(cache))
+                    return NULL;
+                Slot *slot = cache.head;
+                cache.head = slot->next;
+                cache.count--;
+                return slot;
+            }
+        }
+#endif
+        Slot *slot = NULL;
+        m_Lock.lock();
+        TakeSlots(1, &slot);
+        m_Lock.unlock();
+        return slot;
+    }
+
+    __inline void deallocate(void *_Nullable p)
+    {
+        if (!p)
+            return;
+        Slot *slot = (Slot*)p;
+#ifndef DISABLE_THREAD_CACHE
+        if (UseThreadCache) {
+            ThreadCache& cache = GetThreadCache();
+            if (BindThreadCache(cache)) {
+                slot->next = cache.head;
+                cache.head = slot;
+                if (++cache.count > CacheDepth)
+                    FlushThreadCache(cache, CacheDepth - CacheBatch);
+                return;
+            }
+        }
+#endif
+        m_Lock.lock();
+        slot->next = m_Free;
+        m_Free = slot;
+        m_Lock.unlock();
+    }
+
+    // True if p lies in one of this pool's chunks
+    bool Owns(const void *_Nullable p)
+    {
+        m_Lock.lock();
+        bool found = false;
+        for (Chunk *chunk = m_Chunks; chunk && !found; chunk = chunk->next)
+            found = (const char*)p >= (const char*)chunk + ChunkHeader && (const char*)p < (const char*)chunk + ChunkSize;
+        m_Lock.unlock();
+        return found;
+    }
+
+    __inline size_t GetChunkCount() const { return m_ChunkCount; }
+    __inline size_t GetCapacity() const { return m_ChunkCount * ChunkCount; }
+
+protected:
+    // Per-thread slot list, plain aggregate like FreedomPool's so the thread_local needs no constructor
+    struct ThreadCache {
+        FreedomObjectPool *_Nullable    owner;
+        uint64_t                        generation;     // owner's, tells it from a pool later built at its address
+        Slot *_Nullable                 head;
+        size_t                          count;
+    };
+
+    __inline static ThreadCache& GetThreadCache()
+    {
+        static thread_local ThreadCache cache;
+        return cache;
+    }
+
+    // Unique per pool instance of the type, 0 is no pool
+    __inline static uint64_t NextGeneration()
+    {
+        static std::atomic<uint64_t> generation(0);
+        return generation.fetch_add(1, std::memory_order_relaxed) + 1;
+    }
+
+    // Forget the cached slots without returning them, their chunks went back with a destroyed pool
+    __inline static void ResetThreadCache(ThreadCache& cache)
+    {
+        cache.owner = NULL;
+        cache.generation = 0;
+        cache.head = NULL;
+        cache.count = 0;
+    }
+
+    // A thread caches for the first pool of this type it uses, the others go to their lists directly.
+    // A cache left over from a destroyed pool at this address is dropped
+    __inline bool BindThreadCache(ThreadCache& cache)
+    {
+        if (cache.owner == this) {
+            if (cache.generation == m_Generation)
+                return true;
+            ResetThreadCache(cache);
+        }
+        if (cache.owner)
+            return false;
+        cache.owner = this;
+        cache.generation = m_Generation;
+        pthread_setspecific(m_CacheKey, &cache);
+        return true;
+    }
+
+    bool RefillThreadCache(ThreadCache& cache)
+    {
+        Slot *slots[CacheBatch];
+        m_Lock.lock();
+        size_t count = TakeSlots(CacheBatch, slots);
+        m_Lock.unlock();
+
+        for (size_t i = 0; i < count; i++) {
+            slots[i]->next = cache.head;
+            cache.head = slots[i];
+        }
+        cache.count += count;
+        return count > 0;
+    }
+
+    // Hand all but keep cached slots back to the pool's list with one lock round-trip
+    void FlushThreadCache(ThreadCache& cache, size_t keep)
+    {
+        if (cache.count <= keep)
+            return;
+
+        Slot *first = cache.head;
+        Slot *last = first;
+        for (size_t i = keep + 1; i < cache.count; i++)
+            last = last->next;
+        cache.head = last->next;
+        cache.count = keep;
+
+        m_Lock.lock();
+        last->next = m_Free;
+        m_Free = first;
+        m_Lock.unlock();
+    }
+
+    static void ReleaseThreadCache(void *_Nullable arg)
+    {
+        ThreadCache *cache = (ThreadCache*)arg;
+        if (cache && cache->owner) {
+            cache->owner->FlushThreadCache(*cache, 0);
+            cache->owner = NULL;
+        }
+    }
+
+    // Take up to count slots: freed ones first, then fresh ones off the current chunk, then a new
+    // chunk. Must be called with the lock held, returns the number taken
+    size_t TakeSlots(size_t count, Slot *_Nullable *_Nonnull out)
+    {
+        size_t taken = 0;
+        while (taken < count && m_Free) {
+            out[taken++] = m_Free;
+            m_Free = m_Free->next;
+        }
+        while (taken < count) {
+            if (m_Bump == m_BumpEnd && !NewChunk())
+                break;
+            out[taken++] = (Slot*)m_Bump;
+            m_Bump += SlotSize;
+        }
+        return taken;
+    }
+
+    // Fresh chunks are handed out slot by slot, their memory is only touched as it is used
+    bool NewChunk()
+    {
+        Chunk *chunk = (Chunk*)m_Pool.memalign(SlotAlign, ChunkSize);
+        if (!chunk)
+            return false;
+        chunk->next = m_Chunks;
+        m_Chunks = chunk;
+        m_ChunkCount++;
+        m_Bump = (char*)chunk + ChunkHeader;
+        m_BumpEnd = (char*)chunk + ChunkSize;
+        return true;
+    }
+
+private:
+    FreedomPool<poolsize, Placement>& m_Pool;   // where the chunks come from
+    AtomicLock m_Lock;                          // guards everything below
+    Chunk *_Nullable m_Chunks;                  // all chunks, to give them back
+    size_t m_ChunkCount;
+    Slot *_Nullable m_Free;                     // freed slots, LIFO
+    char *_Nullable m_Bump;                     // next untouched slot of the newest chunk
+    char *_Nullable m_BumpEnd;
+    pthread_key_t m_CacheKey;                   // flushes thread caches on thread exit
+    uint64_t m_Generation;                      // NextGeneration(), matched by the caches bound to this pool
+};
@@ -1,30 +1,32 @@
-//  freedom_pool.cpp v1.5 (c)2023-2025 Dmitry Boldyrev
+//  freedom_pool.cpp v1.6 (c)2023-2025 Dmitry Boldyrev
 //
 //  This is the most efficient block-pool memory management system you can find.
 //  I tried many before writing my own: rpmalloc, tlsf, etc.
 //  This code is partially based off this block allocator concept:
 //  https://www.codeproject.com/Articles/1180070/Simple-Variable-Size-Memory-Block-Allocator
 //
-//  NEW (v1.5): Implemented IsValidPointer for safety, modernized volatile m_Internal with std::atomic
+//  NEW (v1.6): Per-thread caches, TLSF index with in-pool boundary tags, slab tier, memalign family
 
 #include "freedom_pool.h"
 
-#define BIGPOOL_MALLOC bigpool.malloc
-#define BIGPOOL_USABLE_SIZE bigpool.malloc_usable_size
-#define BIGPOOL_FREE bigpool.free
-#define BIGPOOL_SIZE bigpool.malloc_size
-#define BIGPOOL_CALLOC bigpool.calloc
-#define BIGPOOL_REALLOC bigpool.realloc
-
 #define ABS(x) (((x)<0)?-(x):(x))
 #define PRINT_V(x) ((ABS(x)/MBYTE) > 0) ? (x)/MBYTE : (x)/KBYTE, (((x)/MBYTE) > 0) ? "MB" : "kb"
 
+// Aligned frees are told the alignment the block was allocated with, debug builds check the pointer has it
+#ifndef NDEBUG
+#define ASSERT_ALIGNED(ptr, alignment) assert(((uintptr_t)(ptr) & ((size_t)(alignment) - 1)) == 0)
+#else
+#define ASSERT_ALIGNED(ptr, alignment) ((void)(alignment))
+#endif
+
 real_malloc_ptr _Nullable real_malloc = nullptr;
 real_free_ptr _Nullable real_free = nullptr;
 real_calloc_ptr _Nullable real_calloc = nullptr;
 real_realloc_ptr _Nullable real_realloc = nullptr;
 real_malloc_size_ptr _Nullable real_malloc_size = nullptr;
 real_malloc_usable_size_ptr _Nullable real_malloc_usable_size = nullptr;
+real_posix_memalign_ptr _Nullable real_posix_memalign = nullptr;
+real_malloc_trim_ptr _Nullable real_malloc_trim = nullptr;
 
 static int64_t heap_alloc = 0L;
 static int64_t heap_max_alloc = 0L;
@@ -35,7 +37,308 @@ void reset_freedom_counters(void)
     heap_max_alloc = 0;
 }
 
+#ifndef BOOTSTRAP_SIZE
+#define BOOTSTRAP_SIZE (64 * KBYTE)
+#endif
+
+// Bump allocated, each allocation is preceded by its size. Frees are ignored, dlsym() needs a few
+// hundred bytes once per process
+alignas(64) static char bootstrap_heap[BOOTSTRAP_SIZE];
+static std::atomic<size_t> bootstrap_used(0);
+
+void *_Nullable bootstrap_malloc(size_t nb_bytes, size_t alignment)
+{
+    uintptr_t base = (uintptr_t)bootstrap_heap;
+    alignment = std::max(alignment, (size_t)MEMORY_ALIGNMENT);
+    nb_bytes = std::max(nb_bytes, (size_t)1);   // a size of 0 would read as not bootstrap memory
+    
+    size_t used = bootstrap_used.load(std::memory_order_relaxed);
+    size_t start;
+    do {
+        start = ALIGN_UP(base + used + MEMORY_ALIGNMENT, alignment) - base;
+        if (nb_bytes > BOOTSTRAP_SIZE || start + nb_bytes > BOOTSTRAP_SIZE) {
+            errno = ENOMEM;
+            return NULL;
+        }
+    } while (!bootstrap_used.compare_exchange_weak(used, start + nb_bytes, std::memory_order_relaxed));
+    
+    *(size_t*)(bootstrap_heap + start - sizeof(size_t)) = nb_bytes;
+    return bootstrap_heap + start;
+}
+
+size_t bootstrap_size(const void *_Nullable ptr)
+{
+    if ((uintptr_t)ptr < (uintptr_t)bootstrap_heap || (uintptr_t)ptr >= (uintptr_t)bootstrap_heap + BOOTSTRAP_SIZE)
+        return 0;
+    return *(const size_t*)((const char*)ptr - sizeof(size_t));
+}
+
+#ifdef FREEDOM_PRELOAD
+
+// LD_PRELOAD build (see the Makefile). Other libraries allocate before this one's constructors run
+// and free after its destructors, so the pool is built in place by the first call that needs it
+// and is never destroyed
+union PreloadStorage {
+    PreloadStorage() {}
+    ~PreloadStorage() {}
+    FreedomPool<DEFAULT_GROW> pool;
+};
+static PreloadStorage preload_storage;
+static std::atomic<int> preload_state(0);           // 0 not built, 1 building, 2 ready
+FreedomPool<DEFAULT_GROW>& bigpool = preload_storage.pool;
+
+#else
+// Built before and destroyed after the statics of other files (GCC/clang on ELF),
+// so their constructors and destructors can allocate and free through it
+#if defined(__GNUC__) && !defined(__APPLE__)
+FreedomPool<DEFAULT_GROW> bigpool __attribute__((init_priority(101)));
+#else
 FreedomPool<DEFAULT_GROW> bigpool;
+#endif
+#endif
+
+#ifdef FREEDOM_TRACE
+
+// Each thread fills its own buffer (mmapped, the trace must not allocate) and appends it to the
+// file with one write when full, at thread exit and at process exit. O_APPEND keeps the chunks whole,
+// records of different threads are only ordered by their timestamps
+
+struct TraceBuffer {
+    uint32_t thread;
+    uint32_t count;
+    TraceRecord records[TRACE_BUFFER_RECORDS];
+};
+
+static int trace_fd = -1;
+static std::atomic<int> trace_state(0);         // 0 not started, 1 starting, 2 tracing, 3 off
+static std::atomic<uint32_t> trace_threads(0);
+static uint64_t trace_start = 0;
+static pthread_key_t trace_key;
+static thread_local TraceBuffer *_Nullable trace_buffer = nullptr;
+
+static uint64_t trace_clock(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void trace_flush(TraceBuffer *_Nonnull buffer)
+{
+    if (buffer->count) {
+        ssize_t written = write(trace_fd, buffer->records, buffer->count * sizeof(TraceRecord));
+        (void)written;
+        buffer->count = 0;
+    }
+}
+
+static void trace_thread_exit(void *_Nullable arg)
+{
+    TraceBuffer *buffer = (TraceBuffer*)arg;
+    trace_flush(buffer);
+    trace_buffer = nullptr;
+    munmap(buffer, sizeof(TraceBuffer));
+}
+
+static void trace_process_exit(void)
+{
+    if (trace_buffer)
+        trace_flush(trace_buffer);
+}
+
+// Open the trace named by FREEDOM_TRACE_FILE on the first call, tracing stays off without it
+static bool trace_begin(void)
+{
+    int state = trace_state.load(std::memory_order_acquire);
+    if (state >= 2)
+        return state == 2;
+    if (state == 1 || !trace_state.compare_exchange_strong(state, 1))
+        return false;                           // another thread is opening it, skip these calls
+    
+    const char *path = getenv("FREEDOM_TRACE_FILE");
+    if (path)
+        trace_fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+    if (trace_fd < 0 || write(trace_fd, TRACE_MAGIC, 8) != 8) {
+        trace_state.store(3, std::memory_order_release);
+        return false;
+    }
+    trace_start = trace_clock();
+    pthread_key_create(&trace_key, trace_thread_exit);
+    atexit(trace_process_exit);
+    trace_state.store(2, std::memory_order_release);
+    return true;
+}
+
+static void trace_record(uint32_t op, const void *_Nullable ptr, uint64_t old, uint64_t size)
+{
+    if (!trace_begin())
+        return;
+    
+    TraceBuffer *buffer = trace_buffer;
+    if (!buffer) {
+        buffer = (TraceBuffer*)mmap(NULL, sizeof(TraceBuffer), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON, -1, 0);
+        if (buffer == MAP_FAILED)
+            return;
+        buffer->thread = trace_threads++;
+        buffer->count = 0;
+        trace_buffer = buffer;
+        pthread_setspecific(trace_key, buffer);
+    }
+    
+    TraceRecord& record = buffer->records[buffer->count];
+    record.time = trace_clock() - trace_start;
+    record.ptr = (uint64_t)(uintptr_t)ptr;
+    record.old = old;
+    record.size = size;
+    record.thread = buffer->thread;
+    record.op = op;
+    
+    if (++buffer->count == TRACE_BUFFER_RECORDS)
+        trace_flush(buffer);
+}
+
+#define TRACE(op, ptr, old, size) trace_record(op, ptr, (uint64_t)(old), size)
+#else
+#define TRACE(op, ptr, old, size) do {} while (0)
+#endif
+
+// fork() from a threaded program must not leave the child with a lock held by a thread that isn't there
+static void fork_prepare(void)
+{
+    bigpool.ForkPrepare();
+}
+
+static void fork_parent(void)
+{
+    bigpool.ForkParent();
+}
+
+static void fork_child(void)
+{
+    bigpool.ForkChild();
+#ifdef FREEDOM_TRACE
+    // the parent writes out what this thread had buffered
+    if (trace_buffer)
+        trace_buffer->count = 0;
+#endif
+}
+
+#ifdef FREEDOM_PRELOAD
+
+// True once bigpool is built, the first call builds it. Calls made meanwhile, from the building
+// thread or any other, get false and must not touch it
+static bool preload_ready(void)
+{
+    if (preload_state.load(std::memory_order_acquire) == 2)
+        return true;
+    
+    int state = 0;
+    if (!preload_state.compare_exchange_strong(state, 1, std::memory_order_acq_rel))
+        return state == 2;
+    
+    new (&preload_storage.pool) FreedomPool<DEFAULT_GROW>;
+    pthread_atfork(fork_prepare, fork_parent, fork_child);
+    preload_state.store(2, std::memory_order_release);
+    return true;
+}
+
+// While bigpool is being built the calls go to the system allocator, or to the bootstrap heap
+// while dlsym() runs. No pool or huge mapping exists yet, so a pointer is either of those two
+static void *_Nullable outside_malloc(size_t nb_bytes)
+{
+    if (!real_malloc) FreedomPool<DEFAULT_GROW>::initialize_overrides();
+    return real_malloc ? real_malloc(nb_bytes) : bootstrap_malloc(nb_bytes, MEMORY_ALIGNMENT);
+}
+
+static void outside_free(void *_Nullable ptr)
+{
+    if (!ptr || bootstrap_size(ptr))
+        return;
+    if (!real_free) FreedomPool<DEFAULT_GROW>::initialize_overrides();
+    if (real_free)
+        real_free(ptr);
+}
+
+static size_t outside_size(const void *_Nullable ptr)
+{
+    size_t length = bootstrap_size(ptr);
+    if (length || !ptr)
+        return length;
+    if (!real_malloc_usable_size) FreedomPool<DEFAULT_GROW>::initialize_overrides();
+    return real_malloc_usable_size ? real_malloc_usable_size(ptr) : 0;
+}
+
+static void *_Nullable outside_calloc(size_t count, size_t size)
+{
+    size_t total_size;
+    if (__builtin_mul_overflow(count, size, &total_size)) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    if (!real_calloc) FreedomPool<DEFAULT_GROW>::initialize_overrides();
+    // the bootstrap heap is never reused, it is still zero
+    return real_calloc ? real_calloc(count, size) : bootstrap_malloc(total_size, MEMORY_ALIGNMENT);
+}
+
+static void *_Nullable outside_realloc(void *_Nullable ptr, size_t nb_bytes)
+{
+    size_t length = bootstrap_size(ptr);
+    if (!real_realloc) FreedomPool<DEFAULT_GROW>::initialize_overrides();
+    if (real_realloc && ptr && !length)
+        return real_realloc(ptr, nb_bytes);
+    
+    void *_Nullable new_ptr = outside_malloc(nb_bytes);
+    if (new_ptr && length)
+        memcpy(new_ptr, ptr, std::min(length, nb_bytes));
+    return new_ptr;
+}
+
+static void *_Nullable outside_memalign(size_t alignment, size_t nb_bytes)
+{
+    if (!alignment || (alignment & (alignment - 1))) {
+        errno = EINVAL;
+        return NULL;
+    }
+    if (!real_posix_memalign) FreedomPool<DEFAULT_GROW>::initialize_overrides();
+    if (!real_posix_memalign)
+        return bootstrap_malloc(nb_bytes, alignment);
+    void *ptr = NULL;
+    return real_posix_memalign(&ptr, std::max(alignment, sizeof(void*)), nb_bytes) == 0 ? ptr : NULL;
+}
+
+// FREEDOM_DECAY_MS=n starts the decay purger, LD_PRELOAD users have no other way to call it
+__attribute__((constructor)) static void preload_init(void)
+{
+    const char *decay = getenv("FREEDOM_DECAY_MS");
+    if (!decay)
+        return;
+    while (!preload_ready())
+        sched_yield();
+    bigpool.StartDecayPurge(atoi(decay));
+}
+
+#define BIGPOOL_MALLOC(n)               (preload_ready() ? bigpool.malloc(n) : outside_malloc(n))
+#define BIGPOOL_USABLE_SIZE(p)          (preload_ready() ? bigpool.malloc_usable_size(p) : outside_size(p))
+#define BIGPOOL_FREE(p)                 (preload_ready() ? bigpool.free(p) : outside_free(p))
+#define BIGPOOL_FREE_SIZED(p, n)        (preload_ready() ? bigpool.free_sized(p, n) : outside_free(p))
+#define BIGPOOL_SIZE(p)                 (preload_ready() ? bigpool.malloc_size(p) : outside_size(p))
+#define BIGPOOL_CALLOC(c, n)            (preload_ready() ? bigpool.calloc(c, n) : outside_calloc(c, n))
+#define BIGPOOL_REALLOC(p, n)           (preload_ready() ? bigpool.realloc(p, n) : outside_realloc(p, n))
+#define BIGPOOL_MEMALIGN(a, n)          (preload_ready() ? bigpool.memalign(a, n) : outside_memalign(a, n))
+#define BIGPOOL_TRIM()                  (preload_ready() ? bigpool.Trim() : 0)
+#else
+static int fork_handlers = pthread_atfork(fork_prepare, fork_parent, fork_child);
+
+#define BIGPOOL_MALLOC bigpool.malloc
+#define BIGPOOL_USABLE_SIZE bigpool.malloc_usable_size
+#define BIGPOOL_FREE bigpool.free
+#define BIGPOOL_FREE_SIZED bigpool.free_sized
+#define BIGPOOL_SIZE bigpool.malloc_size
+#define BIGPOOL_CALLOC bigpool.calloc
+#define BIGPOOL_REALLOC bigpool.realloc
+#define BIGPOOL_MEMALIGN bigpool.memalign
+#define BIGPOOL_TRIM bigpool.Trim
+#endif
 
 #ifndef DISABLE_MALLOC_FREE_OVERRIDE
 
@@ -48,7 +351,9 @@ void *_Nullable malloc(size_t nb_bytes)
     if (nb_bytes >= THRESH_DEBUG_PRINT)
         DEBUG_PRINTF(stderr, "malloc( %8ld %s ) heap: %3lld %s max: %3lld %s\n", PRINT_V(nb_bytes), PRINT_V(heap_alloc), PRINT_V(heap_max_alloc));
 #endif
-    return BIGPOOL_MALLOC(nb_bytes);
+    void *_Nullable ptr = BIGPOOL_MALLOC(nb_bytes);
+    TRACE(TRACE_MALLOC, ptr, 0, nb_bytes);
+    return ptr;
 }
 
 void free(void *_Nullable ptr)
@@ -62,10 +367,30 @@ void free(void *_Nullable ptr)
     if (space >= THRESH_DEBUG_PRINT)
         DEBUG_PRINTF(stderr, "  free( %3lld %s ) heap: %3lld %s\n", PRINT_V(space), PRINT_V(heap_alloc));
 #endif
+    if (ptr)
+        TRACE(TRACE_FREE, ptr, 0, 0);
     BIGPOOL_FREE(ptr);
 }
 
- size_t malloc_usable_size(const void *_Nullable ptr)
+// C23: the caller passes the size back, the pool doesn't have to look it up
+void free_sized(void *_Nullable ptr, size_t nb_bytes)
+{
+#ifdef FREEDOM_DEBUG
+    if (ptr)
+        heap_alloc -= nb_bytes;
+#endif
+    if (ptr)
+        TRACE(TRACE_FREE, ptr, 0, nb_bytes);
+    BIGPOOL_FREE_SIZED(ptr, nb_bytes);
+}
+
+void free_aligned_sized(void *_Nullable ptr, size_t alignment, size_t nb_bytes)
+{
+    ASSERT_ALIGNED(ptr, alignment);
+    free_sized(ptr, nb_bytes);
+}
+
+ size_t malloc_usable_size(void *_Nullable ptr)
  {
      DEBUG_PRINTF(stderr, "malloc_usable_size( %ld )\n", (long)ptr);
      return BIGPOOL_USABLE_SIZE(ptr);
@@ -85,10 +410,9 @@ void *_Nullable realloc(void *_Nullable ptr, size_t nb_bytes)
     // DEBUG_PRINTF(stderr, "realloc( %ld, %ld )\n", (long)p, nb_bytes);
     size_t space = 0;
     if (ptr) { space = BIGPOOL_SIZE(ptr); }
-    
-    void *_Nullable ret = nullptr;
-    ret = BIGPOOL_REALLOC(ptr, nb_bytes);
-    
+#endif
+    void *_Nullable ret = BIGPOOL_REALLOC(ptr, nb_bytes);
+#ifdef FREEDOM_DEBUG
     // don't count freedompool extend
     if (ret) {
         heap_alloc += nb_bytes - space;
@@ -100,9 +424,9 @@ void *_Nullable realloc(void *_Nullable ptr, size_t nb_bytes)
     heap_max_alloc = std::max(heap_max_alloc, heap_alloc);
     if (nb_bytes >= THRESH_DEBUG_PRINT)
         DEBUG_PRINTF(stderr, "realloc( %8ld %s ) heap: %3lld %s\n", PRINT_V(nb_bytes), PRINT_V(heap_alloc));
-    return ret;
 #endif
-    return BIGPOOL_REALLOC(ptr, nb_bytes);
+    TRACE(TRACE_REALLOC, ret, ptr, nb_bytes);
+    return ret;
 }
 
 void *_Nullable calloc(size_t count, size_t size)
@@ -119,8 +443,68 @@ void *_Nullable calloc(size_t count, size_t size)
     if (nb_bytes >= THRESH_DEBUG_PRINT)
         DEBUG_PRINTF(stderr, "calloc( %8ld %s ) heap: %3lld %s %3lld %s\n", PRINT_V(nb_bytes), PRINT_V(heap_alloc), PRINT_V(heap_max_alloc));
 #endif
-    return BIGPOOL_CALLOC(count, size);
+    void *_Nullable ptr = BIGPOOL_CALLOC(count, size);
+    TRACE(TRACE_CALLOC, ptr, 0, count * size);
+    return ptr;
 }
+
+void *_Nullable memalign(size_t alignment, size_t nb_bytes)
+{
+#ifdef FREEDOM_DEBUG
+    heap_alloc += nb_bytes;
+    heap_max_alloc = std::max(heap_max_alloc, heap_alloc);
+    if (nb_bytes >= THRESH_DEBUG_PRINT)
+        DEBUG_PRINTF(stderr, "memalign( %8ld %s, %ld ) heap: %3lld %s\n", PRINT_V(nb_bytes), (long)alignment, PRINT_V(heap_alloc));
+#endif
+    void *_Nullable ptr = BIGPOOL_MEMALIGN(alignment, nb_bytes);
+    TRACE(TRACE_MEMALIGN, ptr, alignment, nb_bytes);
+    return ptr;
+}
+
+int posix_memalign(void *_Nullable *_Nonnull memptr, size_t alignment, size_t nb_bytes)
+{
+    if (alignment < sizeof(void*) || (alignment & (alignment - 1)))
+        return EINVAL;
+    
+    void *_Nullable ptr = memalign(alignment, nb_bytes);
+    if (!ptr)
+        return ENOMEM;
+    
+    *memptr = ptr;
+    return 0;
+}
+
+void *_Nullable aligned_alloc(size_t alignment, size_t nb_bytes)
+{
+    return memalign(alignment, nb_bytes);
+}
+
+void *_Nullable valloc(size_t nb_bytes)
+{
+    return memalign(getpagesize(), nb_bytes);
+}
+
+#ifdef __linux__
+
+// glibc extensions, the rest of its malloc family (mallopt, mallinfo) is left to glibc
+
+void *_Nullable pvalloc(size_t nb_bytes)
+{
+    size_t page = getpagesize();
+    return memalign(page, ALIGN_UP(std::max(nb_bytes, (size_t)1), page));
+}
+
+// Releases the pool's free pages, and glibc's for what it allocated before the pool took over
+int malloc_trim(size_t pad)
+{
+    size_t released = BIGPOOL_TRIM();
+    if (!real_malloc_trim)
+        FreedomPool<DEFAULT_GROW>::initialize_overrides();
+    int trimmed = real_malloc_trim ? real_malloc_trim(pad) : 0;
+    return released || trimmed;
+}
+
+#endif
 #endif // DISABLE_MALLOC_FREE_OVERRIDE
 
 #ifndef DISABLE_NEWDELETE_OVERRIDE
@@ -128,6 +512,7 @@ void *_Nullable calloc(size_t count, size_t size)
 void * operator new(std::size_t nb_bytes)
 {
     void *ptr = BIGPOOL_MALLOC(nb_bytes);
+    TRACE(TRACE_NEW, ptr, 0, nb_bytes);
 #ifdef FREEDOM_DEBUG
     heap_alloc += nb_bytes;
 #ifdef BREAK_ON_THRESH
@@ -152,12 +537,15 @@ void operator delete(void *_Nullable ptr) throw()
     if (space >= THRESH_DEBUG_BREAK)
         DEBUG_PRINTF(stderr, "delete( %3lld %s %7x) heap: %3lld %s\n", PRINT_V(space), ptr, PRINT_V(heap_alloc));
 #endif
-     BIGPOOL_FREE(ptr);
+    if (ptr)
+        TRACE(TRACE_DELETE, ptr, 0, 0);
+    BIGPOOL_FREE(ptr);
 }
 
 void *operator new[](std::size_t nb_bytes)
 {
     void *ptr = BIGPOOL_MALLOC(nb_bytes);
+    TRACE(TRACE_NEW, ptr, 0, nb_bytes);
 #ifdef FREEDOM_DEBUG
     heap_alloc += nb_bytes;
     heap_max_alloc = std::max(heap_max_alloc, heap_alloc);
@@ -182,7 +570,114 @@ void operator delete[](void *ptr) throw()
     if (space >= THRESH_DEBUG_BREAK)
         DEBUG_PRINTF(stderr, " del[]( %8ld %s %7x ) heap: %3lld %s\n", PRINT_V(space), ptr, PRINT_V(heap_alloc));
 #endif
+    if (ptr)
+        TRACE(TRACE_DELETE, ptr, 0, 0);
     BIGPOOL_FREE(ptr);
 }
 
+// Sized delete (C++14), the compiler knows the size so the header is never read for it
+void operator delete(void *_Nullable ptr, std::size_t nb_bytes) throw()
+{
+#ifdef FREEDOM_DEBUG
+    if (ptr)
+        heap_alloc -= nb_bytes;
+#endif
+    if (ptr)
+        TRACE(TRACE_DELETE, ptr, 0, nb_bytes);
+    BIGPOOL_FREE_SIZED(ptr, nb_bytes);
+}
+
+void operator delete[](void *_Nullable ptr, std::size_t nb_bytes) throw()
+{
+#ifdef FREEDOM_DEBUG
+    if (ptr)
+        heap_alloc -= nb_bytes;
+#endif
+    if (ptr)
+        TRACE(TRACE_DELETE, ptr, 0, nb_bytes);
+    BIGPOOL_FREE_SIZED(ptr, nb_bytes);
+}
+
+#ifdef __cpp_aligned_new
+
+void *operator new(std::size_t nb_bytes, std::align_val_t al)
+{
+    void *ptr = BIGPOOL_MEMALIGN((size_t)al, nb_bytes);
+    TRACE(TRACE_MEMALIGN, ptr, al, nb_bytes);
+#ifdef FREEDOM_DEBUG
+    heap_alloc += nb_bytes;
+    heap_max_alloc = std::max(heap_max_alloc, heap_alloc);
+    if (nb_bytes >= THRESH_DEBUG_PRINT)
+        DEBUG_PRINTF(stderr, "   new( %3lld %s %7x, align %ld ) heap: %3lld %s\n", PRINT_V(nb_bytes), ptr, (long)al, PRINT_V(heap_alloc));
+#endif
+    return ptr;
+}
+
+void operator delete(void *_Nullable ptr, std::align_val_t al) throw()
+{
+    ASSERT_ALIGNED(ptr, al);
+#ifdef FREEDOM_DEBUG
+    size_t space = 0;
+    if (ptr) { space = BIGPOOL_SIZE(ptr); }
+    if (space > 0)
+        heap_alloc -= space;
+#endif
+    if (ptr)
+        TRACE(TRACE_DELETE, ptr, 0, 0);
+    BIGPOOL_FREE(ptr);
+}
+
+void *operator new[](std::size_t nb_bytes, std::align_val_t al)
+{
+    void *ptr = BIGPOOL_MEMALIGN((size_t)al, nb_bytes);
+    TRACE(TRACE_MEMALIGN, ptr, al, nb_bytes);
+#ifdef FREEDOM_DEBUG
+    heap_alloc += nb_bytes;
+    heap_max_alloc = std::max(heap_max_alloc, heap_alloc);
+    if (nb_bytes >= THRESH_DEBUG_PRINT)
+        DEBUG_PRINTF(stderr, " new[]( %8ld %s %7x, align %ld ) heap: %3lld %s\n", PRINT_V(nb_bytes), ptr, (long)al, PRINT_V(heap_alloc));
+#endif
+    return ptr;
+}
+
+void operator delete[](void *_Nullable ptr, std::align_val_t al) throw()
+{
+    ASSERT_ALIGNED(ptr, al);
+#ifdef FREEDOM_DEBUG
+    size_t space = 0;
+    if (ptr) { space = BIGPOOL_SIZE(ptr); }
+    if (space > 0)
+        heap_alloc -= space;
+#endif
+    if (ptr)
+        TRACE(TRACE_DELETE, ptr, 0, 0);
+    BIGPOOL_FREE(ptr);
+}
+
+void operator delete(void *_Nullable ptr, std::size_t nb_bytes, std::align_val_t al) throw()
+{
+    ASSERT_ALIGNED(ptr, al);
+#ifdef FREEDOM_DEBUG
+    if (ptr)
+        heap_alloc -= nb_bytes;
+#endif
+    if (ptr)
+        TRACE(TRACE_DELETE, ptr, 0, nb_bytes);
+    BIGPOOL_FREE_SIZED(ptr, nb_bytes);
+}
+
+void operator delete[](void *_Nullable ptr, std::size_t nb_bytes, std::align_val_t al) throw()
+{
+    ASSERT_ALIGNED(ptr, al);
+#ifdef FREEDOM_DEBUG
+    if (ptr)
+        heap_alloc -= nb_bytes;
+#endif
+    if (ptr)
+        TRACE(TRACE_DELETE, ptr, 0, nb_bytes);
+    BIGPOOL_FREE_SIZED(ptr, nb_bytes);
+}
+
+#endif // __cpp_aligned_new
+
 #endif // DISABLE_NEWDELETE_OVERRIDE
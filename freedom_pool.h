@@ -1,26 +1,49 @@
-//  freedom_pool.h v1.5 (c)2023-2025 Dmitry Boldyrev
+//  freedom_pool.h v1.6 (c)2023-2025 Dmitry Boldyrev
 //
 //  This is the most efficient block-pool memory management system you can find.
 //  I tried many before writing my own: rpmalloc, tlsf, etc.
 //  This code is partially based off this block allocator concept:
 //  https://www.codeproject.com/Articles/1180070/Simple-Variable-Size-Memory-Block-Allocator
 //
-//  NEW (v1.5): Implemented IsValidPointer for safety, modernized volatile m_Internal with std::atomic
+//  NEW (v1.6): Per-thread caches, TLSF index with in-pool boundary tags, slab tier, memalign family
 
 #pragma once
 
 #ifdef __cplusplus
 
+// nullability qualifiers are clang only
+#ifndef __clang__
+#define _Nullable
+#define _Nonnull
+#endif
+
 #include <assert.h>
 #include <signal.h>
 #include <dlfcn.h>
+#ifdef __APPLE__
 #include <dispatch/dispatch.h>
 #include <dispatch/queue.h>
 #include <malloc/malloc.h>
+#endif
 #include <assert.h>
+#include <string.h>
+#include <stdio.h>
 #include "atomic.h"
 
-#include <map>
+#include <pthread.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sched.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <malloc.h>
+#endif
+
+#include <new>
+#include <algorithm>
+#include <chrono>
 #include <iostream>
 
 
@@ -29,9 +52,23 @@
 
 //#define DISABLE_MALLOC_FREE_OVERRIDE
 //#define DISABLE_NEWDELETE_OVERRIDE
+//#define DISABLE_THREAD_CACHE
+//#define DISABLE_STATS
+
+// number of arenas, by default one per NUMA node (SINGLE_NODE_ARENAS on single node machines)
+//#define FREEDOM_ARENAS 4
 
-// allocate on the stack (otherwise comment out)
+// allocate on the stack (otherwise comment out, or build with -DFREEDOM_DYNAMIC_ALLOC)
+#ifndef FREEDOM_DYNAMIC_ALLOC
 #define FREEDOM_STACK_ALLOC
+#endif
+
+// back the pool with 2 MB pages to cut TLB misses (Linux only): the dynamic model's reserve comes from
+// hugetlbfs when enough 2 MB pages are free there, otherwise the pool asks for transparent huge pages
+//#define FREEDOM_HUGE_PAGES
+#if defined(FREEDOM_HUGE_PAGES) && !defined(__linux__)
+#undef FREEDOM_HUGE_PAGES
+#endif
 
 //#define FREEDOM_DEBUG
 //#define BREAK_ON_THRESH
@@ -44,8 +81,11 @@ static const size_t THRESH_DEBUG_PRINT  = 20 * MBYTE;
 
 static const size_t DEFAULT_GROW        = 1000 * MBYTE;  // 1.5 GB
 static const size_t GROW_INCREMENT      = 50 * MBYTE;    // 50 MB increment growth
+static const size_t DEFAULT_RESERVE     = 64 * KBYTE * MBYTE;  // 64 GB of address space reserved in the dynamic model
+static const size_t HUGE_THRESHOLD      = 64 * MBYTE;    // default size from which malloc maps memory directly
 
 static const uint64_t TOKEN_ID          = UINT64_C(0x422E465245452100); // 'BE.FREE!'
+static const uint64_t TOKEN_SLAB        = UINT64_C(0x422E534C41422100); // 'BE.SLAB!'
 
 // moved to mem.h #define MALLOC_ALIGN               64
 
@@ -59,6 +99,8 @@ typedef void (*real_free_ptr)(void *_Nullable p);
 typedef void *_Nullable (*real_realloc_ptr)(void *_Nullable p, size_t new_size);
 typedef size_t (*real_malloc_size_ptr)(const void *_Nullable ptr);
 typedef size_t (*real_malloc_usable_size_ptr)(const void *_Nullable ptr);
+typedef int (*real_posix_memalign_ptr)(void *_Nullable *_Nonnull p, size_t alignment, size_t size);
+typedef int (*real_malloc_trim_ptr)(size_t pad);
 
 extern real_malloc_ptr _Nullable real_malloc;
 extern real_free_ptr _Nullable real_free;
@@ -66,79 +108,736 @@ extern real_calloc_ptr _Nullable real_calloc;
 extern real_realloc_ptr _Nullable real_realloc;
 extern real_malloc_size_ptr _Nullable real_malloc_size;
 extern real_malloc_usable_size_ptr _Nullable real_malloc_usable_size;
+extern real_posix_memalign_ptr _Nullable real_posix_memalign;
+extern real_malloc_trim_ptr _Nullable real_malloc_trim;
+
+// Bootstrap heap (freedom_pool.cpp): dlsym() may allocate while initialize_overrides() is still resolving
+// the real functions, those calls get memory from a small static buffer that is never reused
+void *_Nullable bootstrap_malloc(size_t nb_bytes, size_t alignment);
+size_t bootstrap_size(const void *_Nullable ptr);   // 0 if ptr isn't bootstrap memory
 
 void reset_freedom_counters(void);
 
+// Allocation trace (build freedom_pool.cpp with FREEDOM_TRACE and set FREEDOM_TRACE_FILE to a path):
+// the overrides log every call as a TraceRecord, bench/replay plays the file back against a pool
+
+#define TRACE_MAGIC             "FPTRACE1"
+#define TRACE_BUFFER_RECORDS    4096                                        // records buffered per thread before a write
+
+enum {
+    TRACE_MALLOC = 1,
+    TRACE_CALLOC,
+    TRACE_MEMALIGN,         // also aligned operator new, the alignment is in old
+    TRACE_REALLOC,
+    TRACE_FREE,
+    TRACE_NEW,
+    TRACE_DELETE,
+};
+
+struct TraceRecord {
+    uint64_t    time;       // ns since the trace started
+    uint64_t    ptr;        // pointer returned by an allocation, or the one freed
+    uint64_t    old;        // realloc: the pointer passed in, memalign: the alignment
+    uint64_t    size;       // requested size, count * size for calloc
+    uint32_t    thread;     // thread number, in order of their first traced call
+    uint32_t    op;         // TRACE_ op
+};
+
 extern "C" {
     size_t malloc_size(const void *_Nullable ptr);
+#ifndef __linux__
+    // <malloc.h> has these on Linux, along with malloc_trim and pvalloc
     size_t malloc_usable_size(void *_Nullable ptr);
+    void *_Nullable memalign(size_t alignment, size_t size);
+#endif
+    void free_sized(void *_Nullable ptr, size_t size);
+    void free_aligned_sized(void *_Nullable ptr, size_t alignment, size_t size);
 }
 
 // Memory alignment settings
 
-#define MEMORY_ALIGNMENT                128  // 128-byte alignment (cache line size)
+#ifndef MEMORY_ALIGNMENT
+#define MEMORY_ALIGNMENT                16   // 16-byte alignment (max_align_t), memalign() for anything more
+#endif
 
 #define ALIGN_UP(size, alignment)       (((size) + ((alignment) - 1)) & ~((alignment) - 1))
 #define ALIGN_DOWN(size, alignment)     ((size) & ~((alignment) - 1))
 #define IS_ALIGNED(size, alignment)     (((size) & ((alignment) - 1)) == 0)
 
 
-// Structure to track allocation metadata
+// Structure to track allocation metadata, every block in the pool (used or free) starts with one.
+// The pool is a contiguous run of blocks, so block + span is always the next block's header.
 struct BlockHeader {
+    size_t      span;       // Size of the whole block (including header), low bits hold BLOCK_ flags
     size_t      size;       // Size of the allocation (excluding header)
-    size_t      offset;     // Offset in the pool
     uint64_t    token;      // Verification token
+    size_t      offset;     // Offset in the pool
+};
+
+// Free blocks additionally keep their bin links right after the header and a copy of their
+// span in their last word (the boundary tag), so neighbours coalesce without any lookup
+struct FreeLinks {
+    size_t      next;       // Offset of the next free block in the same bin
+    size_t      prev;       // Offset of the previous free block in the same bin
+    uint64_t    stamp;      // Purge tick the block was freed at, PURGE_DONE once its pages went back to the OS
+    size_t      zero;       // The block reads zero from this offset up to its boundary tag, BLOCK_NIL if not known
+};
+
+// Part of a block known to read zero, as offsets in the pool, empty unless begin < end
+struct ZeroRange {
+    size_t      begin;
+    size_t      end;
+};
+
+// A block or slab slot freed while its arena is busy or owned by another thread is pushed onto
+// the arena's lock-free remote free stack, linked through its own (now unused) memory
+struct RemoteFree {
+    RemoteFree* next;       // Next queued free
+};
+
+#define BLOCK_FREE              ((size_t)1)                                 // this block is free
+#define BLOCK_PREV_FREE         ((size_t)2)                                 // the block before is free, its span is in the boundary tag
+#define BLOCK_SPAN_MASK         (~(size_t)(BLOCK_FREE | BLOCK_PREV_FREE))
+#define BLOCK_NIL               SIZE_MAX                                    // end of a bin list
+
+#define BLOCK_FREE_META         (sizeof(BlockHeader) + sizeof(FreeLinks))  // bytes a free block writes at its start
+#define BLOCK_MIN_SPAN          ALIGN_UP(BLOCK_FREE_META + sizeof(size_t), MEMORY_ALIGNMENT)
+#define BLOCK_SENTINEL_SPAN     ALIGN_UP(sizeof(BlockHeader), MEMORY_ALIGNMENT)
+#define BLOCK_SPAN(size)        std::max((size_t)ALIGN_UP((size) + sizeof(BlockHeader), MEMORY_ALIGNMENT), (size_t)BLOCK_MIN_SPAN)
+
+// Two-level segregated fit (TLSF) binning: the first level is the power of two of the size,
+// the second level splits each power of two into TLSF_SL_COUNT linear sub-classes.
+// Both levels are bitmaps, so finding a non-empty bin is a find-first-set, full 64-bit range.
+
+#ifndef TLSF_SL_LOG2
+#define TLSF_SL_LOG2            4                                           // 16 sub-classes per power of two
+#endif
+#define TLSF_SL_COUNT           (1 << TLSF_SL_LOG2)
+#define TLSF_ALIGN_LOG2         __builtin_ctz(MEMORY_ALIGNMENT)
+#define TLSF_FL_SHIFT           (TLSF_SL_LOG2 + TLSF_ALIGN_LOG2)
+#define TLSF_SMALL_BLOCK        ((size_t)1 << TLSF_FL_SHIFT)                // below this sub-classes step by MEMORY_ALIGNMENT
+#define TLSF_FL_COUNT           (64 - TLSF_FL_SHIFT + 1)
+
+// Placement policies - which free block a request gets, the second FreedomPool template parameter.
+// Each is a tag the pool dispatches on at compile time, only the chosen search is compiled in:
+//   PlacementGoodFit     TLSF good fit, the head of the first bin whose blocks all fit. O(1), the default
+//   PlacementBoundedFit  the first of PLACEMENT_SEARCH_LIMIT blocks of the request's own bin that fits, then good fit
+//   PlacementBestFit     the smallest block that fits, from the request's own bin or the next non-empty one
+//   PlacementFirstFit    the lowest addressed block that fits. Bins are kept in address order, which makes
+//                        freeing cost a walk of the bin, long-lived heaps stay packed at the low end
+//   PlacementNextFit     keep cutting the free block the previous allocation was split from, good fit once it
+//                        is too small. Streams of allocations come out back to back without a search
+// -DFREEDOM_PLACEMENT=... changes the default, and with it the policy of bigpool
+
+struct PlacementGoodFit {};
+struct PlacementBoundedFit {};
+struct PlacementBestFit {};
+struct PlacementFirstFit {};
+struct PlacementNextFit {};
+
+#ifndef FREEDOM_PLACEMENT
+#define FREEDOM_PLACEMENT       PlacementGoodFit
+#endif
+#define PLACEMENT_SEARCH_LIMIT  8                                           // bounded fit: blocks tried in the request's bin
+
+// Slab tier - small requests are served from fixed-size slots of SLAB_SIZE slabs carved out of the pool.
+// Each slab keeps a free bitmap in its header, the slots themselves carry no per-object header.
+// A page map (one byte per SLAB_SIZE page of the pool) tells slab pointers from best-fit ones.
+
+#define SLAB_SHIFT              16
+#define SLAB_SIZE               ((size_t)1 << SLAB_SHIFT)                   // 64 KB, slabs are SLAB_SIZE aligned in the pool
+#ifndef SLAB_MAX_SIZE
+#define SLAB_MAX_SIZE           2048                                        // larger requests use the best-fit path
+#endif
+#ifndef SLAB_CLASS_COUNT
+#define SLAB_CLASS_COUNT        24                                          // 8 MEMORY_ALIGNMENT steps, then 4 classes per power of two
+#endif
+#define SLAB_BITMAP_WORDS       ((SLAB_SIZE / 16 + 63) / 64)
+
+#define PAGE_BLOCKS             0                                           // page map: best-fit blocks
+#define PAGE_SLAB               1                                           // page map: start of a slab
+
+struct SlabHeader {
+    uint32_t    slot_size;  // Size of each slot
+    uint32_t    sc;         // Slab class
+    uint32_t    first;      // Offset of the first slot from the slab start
+    uint32_t    slot_count; // Number of slots
+    uint32_t    free_count; // Number of free slots
+    uint32_t    hint;       // First bitmap word that may have a free slot
+    size_t      next;       // Next slab of the class with free slots
+    size_t      prev;       // Previous slab of the class with free slots
+    uint64_t    bitmap[SLAB_BITMAP_WORDS];  // 1 = free slot
+};
+
+// Huge allocations are mapped straight from the OS, outside of the pool, and tracked in a
+// side table (open addressing, linear probing) that lives in its own mapping
+
+#define HUGE_TABLE_MIN          256                                         // initial side table capacity
+
+struct HugeEntry {
+    void*       ptr;        // Start of the mapping, NULL for an empty slot
+    size_t      size;       // Length of the mapping
 };
 
-// Size-class binning for faster allocation - power of 2 binning
+// Arenas - the pool is split into equal slices, each with its own lock, TLSF index and slabs.
+// Threads allocate from the arena of their NUMA node (round-robin on a single node) and fall
+// back to the others when it is full, frees go to the arena the pointer lies in.
+
+#define MAX_ARENAS              16
+#define SINGLE_NODE_ARENAS      4                                           // arenas spread over threads without NUMA
+#define ARENA_MIN_SIZE          (64 * MBYTE)                                // fewer arenas rather than smaller slices
+
+// Per-thread cache settings - slab slots are cached per slab class
+
+#define THREAD_CACHE_DEPTH      64                                          // max cached slots per class
+#define THREAD_CACHE_BATCH      16                                          // slots moved per refill / flush
+
+#define REMOTE_FREE_BATCH       64                                          // queued frees that make the pusher try to drain
+
+// Real-time threads - RegisterRealtimeThread() fills the thread's cache up front, after that its
+// allocations only pop cached slots and fail rather than lock, refill or grow the pool
+
+#define REALTIME_SLOTS          64                                          // default slots reserved per class
+
+// Decay purging - free blocks of at least PURGE_MIN_SIZE that stay free for the decay time get
+// the pages inside them released with madvise (StartDecayPurge, or all at once with Trim()).
+// The address range stays in the pool, the pages come back zeroed on the next touch
+
+#define PURGE_MIN_SIZE          (64 * KBYTE)                                // smaller free blocks keep their pages
+#define PURGE_DECAY_MS          10000                                       // default decay time
+#define PURGE_TICKS             4                                           // purger wake-ups per decay time
+#define PURGE_DONE              UINT64_MAX                                  // stamp of a purged block
+#define PURGE_BATCH             64                                          // blocks taken per arena lock hold
+#ifndef PURGE_ADVICE
+#ifdef __linux__
+#define PURGE_ADVICE            MADV_DONTNEED                               // RSS drops at once (MADV_FREE only under pressure)
+#else
+#define PURGE_ADVICE            MADV_FREE
+#endif
+#endif
+#define PURGE_ZEROES            (PURGE_ADVICE == MADV_DONTNEED)             // purged pages read back as zero
+
+// Huge page backing (FREEDOM_HUGE_PAGES) - the pool and its arena slices start on a huge page,
+// growth commits and purges release whole huge pages so the kernel never has to split one
+
+#define HUGE_PAGE_SIZE          (2 * MBYTE)
+#ifdef FREEDOM_HUGE_PAGES
+#define POOL_ALIGNMENT          HUGE_PAGE_SIZE
+#ifndef MAP_HUGE_2MB
+#define MAP_HUGE_2MB            (21 << 26)                                  // log2 of the page size << MAP_HUGE_SHIFT
+#endif
+#else
+#define POOL_ALIGNMENT          SLAB_SIZE
+#endif
+
+// Statistics - allocation counters are sharded per thread (define DISABLE_STATS to compile them out),
+// arena level figures are kept under the arena locks, GetStats() sums both into a snapshot
+
+#define STATS_SHARDS            32                                          // threads past this many share shards
+#define STAT_BLOCK              SLAB_CLASS_COUNT                            // counter index of best-fit blocks
+#define STAT_HUGE               (SLAB_CLASS_COUNT + 1)                      // counter index of huge mappings
+#define STAT_CLASS_COUNT        (SLAB_CLASS_COUNT + 2)
 
-#define SIZE_CLASS_COUNT        32  // Support up to 4GB objects (with 64-byte alignment)
-#define GET_SIZE_CLASS(size)    (size == 0 ? 0 : __builtin_clz(((uint32_t)(size - 1) >> 6)) ^ 31)
+// One thread's counters, on their own cache lines
+struct alignas(64) StatShard {
+    std::atomic<size_t> allocs[STAT_CLASS_COUNT];   // allocations per slab class, then blocks, then huge
+    std::atomic<size_t> frees[STAT_CLASS_COUNT];    // frees, same classes
+    std::atomic<size_t> alloc_bytes;                // bytes handed out (usable sizes)
+    std::atomic<size_t> free_bytes;                 // bytes given back
+};
+
+struct FreedomStats {
+    size_t      in_use;                     // bytes the program holds, huge allocations included
+    size_t      peak;                       // high-water mark of pool memory in use plus of huge mappings
+    size_t      pool_size;                  // committed pool bytes
+    size_t      free_size;                  // free bytes in the pool
+    size_t      free_blocks;                // number of free blocks
+    size_t      largest_free;               // largest free block, to within its TLSF bin's width
+    double      fragmentation;              // share of free bytes outside their arena's largest block, 0 while each arena's free space is one block
+    size_t      huge_size;                  // bytes mapped for huge allocations
+    size_t      purged;                     // bytes of free pages given back to the OS so far
+    size_t      allocs[STAT_CLASS_COUNT];   // allocations per slab class, then blocks, then huge
+    size_t      frees[STAT_CLASS_COUNT];    // frees, same classes
+    size_t      lock_acquires;              // arena lock acquisitions
+    size_t      lock_contended;             // ... of which found the lock taken
+    uint64_t    lock_wait_ns;               // time spent waiting for them
+};
 
-template <size_t poolsize = DEFAULT_GROW>
+template <size_t poolsize = DEFAULT_GROW, typename Placement = FREEDOM_PLACEMENT>
 class FreedomPool
 {
 public:
     FreedomPool():
-        m_Internal(true),
-        m_MaxSize(0),
-        m_FreeSize(0),
-        m_AllocCount(0),
-        m_FreeCount(0)
+        m_ArenaCount(0),
+        m_NextArena(0)
     {
         initialize_overrides();
-        m_Lock.init();
         
-        // Initialize size classes
-        for (int i = 0; i < SIZE_CLASS_COUNT; i++) {
-            m_SizeClasses[i].clear();
+        m_HugeLock.init();
+        m_HugeTable = NULL;
+        m_HugeCapacity = 0;
+        m_HugeCount = 0;
+        m_HugeBytes = 0;
+        m_HugePeak = 0;
+        m_HugeThreshold = HUGE_THRESHOLD;
+        m_DeferredFrees.store(NULL, std::memory_order_relaxed);
+        m_DumpRunning = false;
+        m_PurgeRunning = false;
+        
+        // the tuning knobs can be set on the command line (bench/replay), they have to agree with each other
+        static_assert(MEMORY_ALIGNMENT >= 16 && !(MEMORY_ALIGNMENT & (MEMORY_ALIGNMENT - 1)) &&
+                      sizeof(BlockHeader) % MEMORY_ALIGNMENT == 0, "MEMORY_ALIGNMENT must be 16 or 32");
+        static_assert(TLSF_SL_LOG2 >= 1 && TLSF_SL_LOG2 <= 5, "TLSF_SL_LOG2 must be 1..5, second levels are 32-bit maps");
+        static_assert(SLAB_MAX_SIZE > 8 * MEMORY_ALIGNMENT && SLAB_MAX_SIZE <= SLAB_SIZE / 16 &&
+                      SlabSlotSize(SlabClass(SLAB_MAX_SIZE)) == SLAB_MAX_SIZE, "SLAB_MAX_SIZE must be the size of a slab class");
+        static_assert(SlabClass(SLAB_MAX_SIZE) + 1 == SLAB_CLASS_COUNT, "SLAB_CLASS_COUNT doesn't match the slab classes up to SLAB_MAX_SIZE");
+        m_PurgeTick.store(0, std::memory_order_relaxed);
+        
+#ifndef DISABLE_STATS
+        for (size_t i = 0; i < STATS_SHARDS; i++) {
+            for (size_t sc = 0; sc < STAT_CLASS_COUNT; sc++) {
+                m_Stats[i].allocs[sc].store(0, std::memory_order_relaxed);
+                m_Stats[i].frees[sc].store(0, std::memory_order_relaxed);
+            }
+            m_Stats[i].alloc_bytes.store(0, std::memory_order_relaxed);
+            m_Stats[i].free_bytes.store(0, std::memory_order_relaxed);
         }
+#endif
         
-#ifndef FREEDOM_STACK_ALLOC
+#ifndef DISABLE_THREAD_CACHE
+        // flushes a thread's cached blocks back to the pool when the thread exits
+        pthread_key_create(&m_CacheKey, ReleaseThreadCache);
+#endif
+        m_Generation = NextGeneration();
+        
+        m_PageSize = getpagesize();
+        m_HugeTlbSize = 0;
+        
+#ifdef FREEDOM_STACK_ALLOC
+        m_Reserved = poolsize;
+        
+        // calloc trusts untouched pool memory to be zero, which only a static pool is sure of.
+        // Dropping the pages makes it so wherever the pool lives, and costs nothing if they never were touched
+#ifdef __linux__
+        m_FreshZero = poolsize % getpagesize() == 0 && madvise(m_Data, poolsize, MADV_DONTNEED) == 0;
+#else
+        m_FreshZero = false;
+#endif
+#ifdef FREEDOM_HUGE_PAGES
+        // the array can't come from hugetlbfs, transparent huge pages fill it as it is touched
+        if (poolsize >= HUGE_PAGE_SIZE && madvise(m_Data, ALIGN_DOWN(poolsize, HUGE_PAGE_SIZE), MADV_HUGEPAGE) == 0)
+            m_PageSize = HUGE_PAGE_SIZE;
+#endif
+#else
+        // pages committed out of the reserve are fresh from the kernel
+        m_FreshZero = true;
+
+        // Reserve the address space once, ExtendPool only commits pages of it so the pool never moves
+        m_Reserved = ALIGN_UP(std::max(poolsize, DEFAULT_RESERVE), POOL_ALIGNMENT);
         m_Data = NULL;
+        int8_t *reserve = (int8_t*)mmap(NULL, m_Reserved + POOL_ALIGNMENT, PROT_NONE, MAP_PRIVATE | MAP_ANON, -1, 0);
+        if (reserve == MAP_FAILED) {
+            fprintf(stderr, "FreedomPool couldn't reserve %zu MB of address space\n", m_Reserved / MBYTE);
+            m_Reserved = 0;
+        } else {
+            // slabs are SLAB_SIZE aligned (huge pages HUGE_PAGE_SIZE), trim the reserve to start on a boundary
+            m_Data = (int8_t*)ALIGN_UP((uintptr_t)reserve, POOL_ALIGNMENT);
+            if (m_Data > reserve)
+                munmap(reserve, m_Data - reserve);
+            munmap(m_Data + m_Reserved, POOL_ALIGNMENT - (m_Data - reserve));
+#ifdef FREEDOM_HUGE_PAGES
+            // A hugetlbfs mapping takes its pages off the hugetlbfs pool up front, so only the pool's
+            // own size comes from there, and only when the free pages cover it. It replaces the start
+            // of the reserve, growth past it commits ordinary pages that ask for transparent huge pages
+            size_t hugetlb = ALIGN_UP(poolsize, HUGE_PAGE_SIZE);
+            if (HugeTlbAvailable() >= hugetlb) {
+                if (mmap(m_Data, hugetlb, PROT_NONE, MAP_PRIVATE | MAP_ANON | MAP_FIXED | MAP_HUGETLB | MAP_HUGE_2MB, -1, 0) != MAP_FAILED)
+                    m_HugeTlbSize = hugetlb;
+                else    // a failed MAP_FIXED may have dropped the range, it is still the pool's
+                    mmap(m_Data, hugetlb, PROT_NONE, MAP_PRIVATE | MAP_ANON | MAP_FIXED, -1, 0);
+            }
+            if (madvise(m_Data + m_HugeTlbSize, m_Reserved - m_HugeTlbSize, MADV_HUGEPAGE) == 0 || m_HugeTlbSize)
+                m_PageSize = HUGE_PAGE_SIZE;
+#endif
+        }
+#endif
+        
+        // One page map byte per SLAB_SIZE page of the whole reserve, it never moves either.
+        // Untouched pages of the mapping read as zero, that is PAGE_BLOCKS
+        m_PageMap = NULL;
+        if (m_Reserved) {
+            void *pagemap = mmap(NULL, PageMapSize(), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON, -1, 0);
+            if (pagemap != MAP_FAILED)
+                m_PageMap = (uint8_t*)pagemap;
+        }
+        if (!m_PageMap)
+            return;
+        
+        // Split the reserve into equal POOL_ALIGNMENT aligned slices, one per arena
+        m_NumaNodes = CountNumaNodes();
+#ifdef FREEDOM_ARENAS
+        size_t count = FREEDOM_ARENAS;
+#else
+        size_t count = m_NumaNodes > 1 ? m_NumaNodes : SINGLE_NODE_ARENAS;
+#endif
+        count = std::min(std::max(count, (size_t)1), (size_t)MAX_ARENAS);
+        while (count > 1 && (m_Reserved / count < ARENA_MIN_SIZE || m_Reserved / count < SLAB_SIZE))
+            count--;
+        
+        // a single arena starts at the pool itself and needs no alignment, it takes all of a small pool.
+        // Slices start on a huge page only when each can hold one, otherwise on a slab
+        size_t alignment = m_Reserved / count >= POOL_ALIGNMENT ? POOL_ALIGNMENT : SLAB_SIZE;
+        m_ArenaSpan = count > 1 ? ALIGN_DOWN(m_Reserved / count, alignment) : ALIGN_DOWN(m_Reserved, MEMORY_ALIGNMENT);
+        
+        for (size_t i = 0; i < count; i++) {
+            InitArena(m_Arenas[i], i * m_ArenaSpan, m_NumaNodes > 1 ? (int)(i % m_NumaNodes) : -1);
+#ifdef FREEDOM_STACK_ALLOC
+            ExtendArena(m_Arenas[i], m_ArenaSpan);
+#else
+            ExtendArena(m_Arenas[i], std::min(poolsize, GROW_INCREMENT) / count);
 #endif
-        ExtendPool(poolsize);
+        }
+        m_ArenaCount = count;
     }
     
     ~FreedomPool()
     {
+        StopStatsDump();
+        StopDecayPurge();
+#ifndef DISABLE_THREAD_CACHE
+        // The slots go back with the pool, the calling thread's cache only has to let go of it.
+        // Other threads' caches are no longer flushed at exit once the key is gone, they still
+        // name this pool but with its generation, which no pool built here later has
+        ThreadCache& cache = GetThreadCache();
+        if (OwnsThreadCache(cache)) {
+            pthread_setspecific(m_CacheKey, NULL);
+            ResetThreadCache(cache);
+        }
+        pthread_key_delete(m_CacheKey);
+#endif
+        if (GetThreadCache().home_pool == this)
+            GetThreadCache().home_pool = NULL;
+        if (m_PageMap)
+            munmap(m_PageMap, PageMapSize());
+        m_PageMap = NULL;
+        for (size_t i = 0; i < m_HugeCapacity; i++) {
+            if (m_HugeTable[i].ptr)
+                munmap(m_HugeTable[i].ptr, m_HugeTable[i].size);
+        }
+        if (m_HugeTable)
+            munmap(m_HugeTable, m_HugeCapacity * sizeof(HugeEntry));
+        m_HugeTable = NULL;
+        m_HugeCapacity = m_HugeCount = 0;
 #ifndef FREEDOM_STACK_ALLOC
         if (m_Data)
-            real_free(m_Data);
+            munmap(m_Data, m_Reserved);
         m_Data = NULL;
 #endif
     }
     
-    // Pool status queries
-    __inline bool IsFull() const { return m_FreeSize == 0; }
-    __inline bool IsEmpty() const { return m_FreeSize == m_MaxSize; }
-    __inline size_t GetMaxSize() const { return m_MaxSize; }
-    __inline size_t GetFreeSize() const { return m_FreeSize; }
-    __inline size_t GetUsedSize() const { return m_MaxSize - m_FreeSize; }
+    // Pool status queries, summed over the arenas
+    __inline bool IsFull() const { return GetFreeSize() == 0; }
+    __inline bool IsEmpty() const { return GetUsedSize() == 0; }
+    __inline size_t GetArenaCount() const { return m_ArenaCount; }
+    __inline size_t GetMaxSize() const
+    {
+        size_t size = 0;
+        for (size_t i = 0; i < m_ArenaCount; i++)
+            size += m_Arenas[i].size;
+        return size;
+    }
+    __inline size_t GetFreeSize() const
+    {
+        size_t size = 0;
+        for (size_t i = 0; i < m_ArenaCount; i++)
+            size += m_Arenas[i].free_size;
+        return size;
+    }
+    __inline size_t GetUsedSize() const { return GetMaxSize() - GetFreeSize() - m_ArenaCount * BLOCK_SENTINEL_SPAN; }
+    __inline size_t GetHugeSize() const { return m_HugeBytes; }
+    __inline size_t GetHugeThreshold() const { return m_HugeThreshold; }
+    
+    // Granularity the pool commits and purges at, HUGE_PAGE_SIZE when it is backed by huge pages
+    __inline size_t GetPageSize() const { return m_PageSize; }
+    __inline bool IsHugeTlb() const { return m_HugeTlbSize != 0; }
+    __inline size_t GetHugeTlbSize() const { return m_HugeTlbSize; }
+    
+    // Requests of at least this size are mapped directly instead of coming out of the pool
+    __inline void SetHugeThreshold(size_t threshold) { m_HugeThreshold = std::max(threshold, (size_t)SLAB_MAX_SIZE + 1); }
+    
+    // Snapshot of the statistics. Shards and arenas are read one after the other,
+    // each figure is consistent on its own but they are not taken at one instant
+    FreedomStats GetStats()
+    {
+        FreedomStats stats;
+        memset(&stats, 0, sizeof(stats));
+        size_t largest_sum = 0;
+        
+        for (size_t i = 0; i < m_ArenaCount; i++) {
+            Arena& arena = m_Arenas[i];
+            arena.lock.lock();
+            stats.pool_size += arena.size;
+            stats.free_size += arena.free_size;
+            stats.free_blocks += arena.free_blocks;
+            size_t largest = LargestFreeBlock(arena);
+            stats.largest_free = std::max(stats.largest_free, largest);
+            largest_sum += largest;
+            stats.peak += arena.used_peak;
+            stats.lock_acquires += arena.lock_count;
+            stats.lock_contended += arena.lock_contended;
+            stats.lock_wait_ns += arena.lock_wait_ns;
+            stats.purged += arena.purged;
+            arena.lock.unlock();
+        }
+        
+        m_HugeLock.lock();
+        stats.huge_size = m_HugeBytes;
+        stats.peak += m_HugePeak;
+        m_HugeLock.unlock();
+        
+#ifndef DISABLE_STATS
+        size_t allocBytes = 0, freeBytes = 0;
+        for (size_t i = 0; i < STATS_SHARDS; i++) {
+            for (size_t sc = 0; sc < STAT_CLASS_COUNT; sc++) {
+                stats.allocs[sc] += m_Stats[i].allocs[sc].load(std::memory_order_relaxed);
+                stats.frees[sc] += m_Stats[i].frees[sc].load(std::memory_order_relaxed);
+            }
+            allocBytes += m_Stats[i].alloc_bytes.load(std::memory_order_relaxed);
+            freeBytes += m_Stats[i].free_bytes.load(std::memory_order_relaxed);
+        }
+        stats.in_use = allocBytes - freeBytes;
+#else
+        // without the shards, cached slots and unused slab space count as in use
+        stats.in_use = stats.pool_size - stats.free_size - m_ArenaCount * BLOCK_SENTINEL_SPAN + stats.huge_size;
+#endif
+        
+        // an arena's free space is fragmented against its own largest block, blocks of other arenas can't join it.
+        // Weighted by free bytes the per arena 1 - largest / free sum up to 1 - the largest blocks over all free bytes
+        stats.fragmentation = stats.free_size ? 1.0 - (double)largest_sum / stats.free_size : 0.0;
+        return stats;
+    }
+    
+    // Print a snapshot, one line of JSON or a short text report
+    void DumpStats(FILE *_Nonnull out, bool json)
+    {
+        FreedomStats stats = GetStats();
+        size_t allocs = 0, frees = 0;
+        for (size_t sc = 0; sc < STAT_CLASS_COUNT; sc++) {
+            allocs += stats.allocs[sc];
+            frees += stats.frees[sc];
+        }
+        
+        if (json) {
+            fprintf(out, "{\"in_use\":%zu,\"peak\":%zu,\"pool_size\":%zu,\"free_size\":%zu,\"free_blocks\":%zu,"
+                    "\"largest_free\":%zu,\"fragmentation\":%.4f,\"huge_size\":%zu,\"purged\":%zu,\"allocs\":%zu,\"frees\":%zu,"
+                    "\"lock_acquires\":%zu,\"lock_contended\":%zu,\"lock_wait_ns\":%llu,\"classes\":[",
+                    stats.in_use, stats.peak, stats.pool_size, stats.free_size, stats.free_blocks, stats.largest_free,
+                    stats.fragmentation, stats.huge_size, stats.purged, allocs, frees, stats.lock_acquires,
+                    stats.lock_contended, (unsigned long long)stats.lock_wait_ns);
+            for (size_t sc = 0; sc < STAT_CLASS_COUNT; sc++)
+                fprintf(out, "%s[%zu,%zu]", sc ? "," : "", stats.allocs[sc], stats.frees[sc]);
+            fprintf(out, "]}\n");
+            return;
+        }
+        
+        fprintf(out, "FreedomPool: in use %zu kb (peak %zu kb), pool %zu MB, free %zu kb in %zu blocks, largest %zu kb, "
+                "fragmentation %.1f%%, huge %zu kb, purged %zu kb\n", stats.in_use / KBYTE, stats.peak / KBYTE,
+                stats.pool_size / MBYTE, stats.free_size / KBYTE, stats.free_blocks, stats.largest_free / KBYTE,
+                stats.fragmentation * 100.0, stats.huge_size / KBYTE, stats.purged / KBYTE);
+        fprintf(out, "FreedomPool: %zu allocs, %zu frees, %zu lock acquisitions, %zu contended, %.3f ms waiting\n",
+                allocs, frees, stats.lock_acquires, stats.lock_contended, stats.lock_wait_ns / 1e6);
+        for (size_t sc = 0; sc < STAT_CLASS_COUNT; sc++) {
+            if (!stats.allocs[sc])
+                continue;
+            if (sc < SLAB_CLASS_COUNT)
+                fprintf(out, "    %6zu bytes: %zu allocs %zu frees\n", SlabSlotSize(sc), stats.allocs[sc], stats.frees[sc]);
+            else
+                fprintf(out, "    %12s: %zu allocs %zu frees\n", sc == STAT_BLOCK ? "blocks" : "huge", stats.allocs[sc], stats.frees[sc]);
+        }
+    }
+    
+    // Dump the statistics to stderr every interval_ms from a background thread, until StopStatsDump()
+    bool StartStatsDump(unsigned interval_ms, bool json = false)
+    {
+        if (m_DumpRunning)
+            return false;
+        m_DumpInterval = (uint64_t)interval_ms * 1000000ULL;
+        m_DumpJson = json;
+        m_DumpSema.init(0, 0);
+        m_DumpRunning = pthread_create(&m_DumpThread, NULL, StatsDumpThread, this) == 0;
+        return m_DumpRunning;
+    }
+    
+    void StopStatsDump()
+    {
+        if (!m_DumpRunning)
+            return;
+        m_DumpSema.signal();
+        pthread_join(m_DumpThread, NULL);
+        m_DumpRunning = false;
+    }
+    
+    // Release the pages of free blocks that stayed free for decay_ms, checked from a background
+    // thread PURGE_TICKS times per decay time, until StopDecayPurge()
+    bool StartDecayPurge(unsigned decay_ms = PURGE_DECAY_MS)
+    {
+        if (m_PurgeRunning)
+            return false;
+        m_PurgeInterval = std::max((uint64_t)decay_ms * 1000000 / PURGE_TICKS, (uint64_t)1000000);
+        m_PurgeSema.init(0, 0);
+        m_PurgeRunning = pthread_create(&m_PurgeThread, NULL, DecayPurgeThread, this) == 0;
+        return m_PurgeRunning;
+    }
+    
+    void StopDecayPurge()
+    {
+        if (!m_PurgeRunning)
+            return;
+        m_PurgeSema.signal();
+        pthread_join(m_PurgeThread, NULL);
+        m_PurgeRunning = false;
+    }
+    
+    // Release the pages of every free block now, whatever its age, returns the bytes released.
+    // The calling thread's cached slots go back first, unless they are a real-time reserve
+    size_t Trim()
+    {
+#ifndef DISABLE_THREAD_CACHE
+        ThreadCache& cache = GetThreadCache();
+        if (OwnsThreadCache(cache) && !cache.realtime)
+            FlushThreadCache(cache);
+#endif
+        DrainDeferredFrees();
+        
+        // Frees still queued on the arenas' remote stacks were made before this Trim, they go first
+        for (size_t i = 0; i < m_ArenaCount; i++) {
+            LockArena(m_Arenas[i]);
+            m_Arenas[i].lock.unlock();
+        }
+        
+        // Start a new tick and purge what was stamped before it. A block that coalesces with a
+        // neighbour freed meanwhile is stamped with the new tick, so this pass doesn't purge
+        // (and count) its pages twice. It goes with the next pass
+        m_PurgeTick.fetch_add(1, std::memory_order_relaxed);
+        size_t released = 0;
+        for (size_t i = 0; i < m_ArenaCount; i++)
+            released += PurgeArena(m_Arenas[i], 1);
+        return released;
+    }
+
+    // Make the calling thread real-time: at least slots_per_class slots of every slab class are moved
+    // into its cache now, under the locks and with their pages touched. From then on the thread's
+    // malloc/calloc/realloc of up to SLAB_MAX_SIZE bytes pop from the cache and its frees push onto
+    // it, in bounded time and without a lock. Anything the reserve can't serve - an empty class,
+    // a larger or over-aligned request - returns NULL with errno ENOMEM instead of blocking.
+    // Blocks freed on the thread are queued on their arena's lock-free remote free stack, huge
+    // mappings on the pool's deferred list, unmapped by the next other thread that frees or maps
+    // outside the pool, by Trim() or by the decay purger.
+    // Fails if the thread's cache is bound to another pool or the pool can't supply the slots
+    bool RegisterRealtimeThread(size_t slots_per_class = REALTIME_SLOTS)
+    {
+#ifndef DISABLE_THREAD_CACHE
+        ThreadCache& cache = GetThreadCache();
+        if (!m_ArenaCount || !BindThreadCache(cache))
+            return false;
+        cache.realtime = true;
+        for (size_t sc = 0; sc < SLAB_CLASS_COUNT; sc++) {
+            if (cache.count[sc] < slots_per_class && !ReserveRealtime(SlabSlotSize(sc), slots_per_class - cache.count[sc])) {
+                UnregisterRealtimeThread();
+                return false;
+            }
+        }
+        return true;
+#else
+        return false;
+#endif
+    }
+    
+    // Add at least count slots for nb_bytes requests to the calling real-time thread's reserve
+    bool ReserveRealtime(size_t nb_bytes, size_t count)
+    {
+#ifndef DISABLE_THREAD_CACHE
+        ThreadCache& cache = GetThreadCache();
+        if (!RealtimeThread() || nb_bytes > SLAB_MAX_SIZE)
+            return false;
+        size_t sc = SlabClass(nb_bytes);
+        while (count) {
+            size_t before = cache.count[sc];
+            if (!RefillThreadCache(cache, sc) && !(GrowPool(2 * SLAB_SIZE) && RefillThreadCache(cache, sc)))
+                return false;
+            count -= std::min(count, (size_t)(cache.count[sc] - before));
+        }
+        return true;
+#else
+        return false;
+#endif
+    }
+    
+    // Back to a regular thread, the reserve goes back to the slabs
+    void UnregisterRealtimeThread()
+    {
+#ifndef DISABLE_THREAD_CACHE
+        ThreadCache& cache = GetThreadCache();
+        if (RealtimeThread()) {
+            cache.realtime = false;
+            FlushThreadCache(cache);
+        }
+#endif
+    }
+    
+    __inline bool IsRealtimeThread() { return RealtimeThread(); }
+    
+    // Allocations the calling thread's reserve could not serve since it registered
+    __inline size_t GetRealtimeFailures()
+    {
+#ifndef DISABLE_THREAD_CACHE
+        return RealtimeThread() ? GetThreadCache().failures : 0;
+#else
+        return 0;
+#endif
+    }
+    
+    // fork() handlers, for pthread_atfork (freedom_pool.cpp registers them for bigpool).
+    // Every lock is held across the fork so the child can't inherit one that a thread,
+    // which doesn't exist in the child, took halfway through an allocation
+    void ForkPrepare()
+    {
+        for (size_t i = 0; i < m_ArenaCount; i++)
+            m_Arenas[i].lock.lock();
+        m_HugeLock.lock();
+    }
+    void ForkParent()
+    {
+        m_HugeLock.unlock();
+        for (size_t i = m_ArenaCount; i-- > 0; )
+            m_Arenas[i].lock.unlock();
+    }
+    void ForkChild()
+    {
+        // only the forking thread lives on, the dump and purge threads are gone with the others
+        m_DumpRunning = false;
+        m_PurgeRunning = false;
+        ForkParent();
+    }
     
-    // Initialize function pointers to the real memory functions
+    // Initialize function pointers to the real memory functions. dlsym() may call back into
+    // malloc, those nested calls return at once and are served from the bootstrap heap.
+    // Other threads wait until every pointer is resolved, none of them is used half set
     __inline static void initialize_overrides()
     {
+        static std::atomic<int> state(0);          // 0 unresolved, 1 resolving, 2 resolved
+        static thread_local bool resolving;
+        if (state.load(std::memory_order_acquire) == 2 || resolving)
+            return;
+        
+        int expected = 0;
+        if (!state.compare_exchange_strong(expected, 1, std::memory_order_acquire)) {
+            while (state.load(std::memory_order_acquire) != 2)
+                sched_yield();
+            return;
+        }
+        resolving = true;
+        
         if (!real_malloc) {
             real_malloc = (real_malloc_ptr)dlsym(RTLD_NEXT, "malloc");
         }
@@ -157,65 +856,146 @@ public:
         if (!real_malloc_usable_size) {
             real_malloc_usable_size = (real_malloc_usable_size_ptr)dlsym(RTLD_NEXT, "malloc_usable_size");
         }
+        if (!real_posix_memalign) {
+            real_posix_memalign = (real_posix_memalign_ptr)dlsym(RTLD_NEXT, "posix_memalign");
+        }
+        if (!real_malloc_trim) {
+            real_malloc_trim = (real_malloc_trim_ptr)dlsym(RTLD_NEXT, "malloc_trim");
+        }
+        // malloc_size is Apple only, glibc has the same under its other name
+        if (!real_malloc_size) {
+            real_malloc_size = real_malloc_usable_size;
+        }
+        resolving = false;
+        state.store(2, std::memory_order_release);
     }
     __inline bool IsValidPointer(const void *_Nullable p) const
     {
-        if (!p) return false;
+        if (!p || !m_ArenaCount) return false;
         
         // Get the supposed header address
         uintptr_t header_addr = (uintptr_t)p - sizeof(BlockHeader);
         uintptr_t data_start = (uintptr_t)m_Data;
-        uintptr_t data_end = data_start + m_MaxSize;
+        if (header_addr < data_start || !IS_ALIGNED(header_addr - data_start, MEMORY_ALIGNMENT))
+            return false;
         
-        // Check if both pointer and header are within valid range
-        return (header_addr >= data_start &&
-                (uintptr_t)p < data_end &&
-                IS_ALIGNED(header_addr - data_start, MEMORY_ALIGNMENT));
+        // Both pointer and header must be within the committed part of one arena
+        size_t offset = header_addr - data_start;
+        size_t index = offset / m_ArenaSpan;
+        return index < m_ArenaCount && (uintptr_t)p < data_start + m_Arenas[index].base + m_Arenas[index].size;
+    }
+    // True if the pointer lies inside the pool region at all
+    __inline bool IsPoolPointer(const void *_Nullable p) const
+    {
+        return m_ArenaCount && (uintptr_t)p >= (uintptr_t)m_Data && (uintptr_t)p < (uintptr_t)m_Data + m_ArenaCount * m_ArenaSpan;
     }
     // Aligned memory allocation
     __inline void *_Nullable malloc(size_t nb_bytes)
     {
         if (!real_malloc) initialize_overrides();
         
-        if (m_Internal.load(std::memory_order_relaxed) || !m_MaxSize)
-            return real_malloc(nb_bytes);
+        if (!m_ArenaCount)
+            return real_malloc ? real_malloc(nb_bytes) : bootstrap_malloc(nb_bytes, MEMORY_ALIGNMENT);
+        
+        // Small requests go to the slabs, through the thread cache when enabled
+        if (nb_bytes <= SLAB_MAX_SIZE) {
+            void *ptr = SlabMalloc(SlabClass(nb_bytes));
+            if (ptr)
+                return ptr;
+        }
+        
+        // A real-time thread gets its reserve or nothing
+        if (RealtimeThread())
+            return RealtimeFailed();
+        
+        // Huge requests don't fragment the pool, they get their own mapping
+        if (nb_bytes >= m_HugeThreshold)
+            return HugeMalloc(nb_bytes, 0);
         
         // Calculate aligned size with space for header
         size_t aligned_size = ALIGN_UP(nb_bytes, MEMORY_ALIGNMENT);
-        size_t total_size = aligned_size + sizeof(BlockHeader);
+        size_t total_size = BLOCK_SPAN(aligned_size);
         
-        // Ensure alignment of the header itself
-        total_size = ALIGN_UP(total_size, MEMORY_ALIGNMENT);
-        
-        if (GetFreeSize() < total_size) {
+        void *ptr = Malloc(aligned_size);
+        if (!ptr && GrowPool(total_size))
+            ptr = Malloc(aligned_size);
 #ifdef FREEDOM_STACK_ALLOC
-            DEBUG_PRINTF(stderr, "FreedomPool::malloc() Ran out of space allocating %lld MB used %lld of %lld MB. Static model, returning NULL\n", nb_bytes/MBYTE, GetUsedSize()/MBYTE, GetMaxSize()/MBYTE, (GetUsedSize() + nb_bytes + 3 * sizeof(void*) + GROW_INCREMENT) / MBYTE);
-            return NULL;
-#else
-            DEBUG_PRINTF(stderr, "FreedomPool::malloc() Ran out of space allocating %lld MB used %lld of %lld MB, expanding to %lld MB\n", nb_bytes/MBYTE, GetUsedSize()/MBYTE, GetMaxSize()/MBYTE, (GetUsedSize() + nb_bytes + 3 * sizeof(void*) + GROW_INCREMENT) / MBYTE);
-            dispatch_async( dispatch_get_main_queue(), ^{
-                // grow pool by GROW_INCREMENT MB + requested size
-                ExtendPool( GetUsedSize() + nb_bytes + 3 * sizeof(void*) + GROW_INCREMENT * MBYTE);
-            });
+        if (!ptr)
+            DEBUG_PRINTF(stderr, "FreedomPool::malloc() Ran out of space allocating %lld MB used %lld of %lld MB. Static model, returning NULL\n", nb_bytes/MBYTE, GetUsedSize()/MBYTE, GetMaxSize()/MBYTE);
 #endif
+        return ptr;
+    }
+    
+    // Aligned allocation for any power of two alignment, served straight from the pool
+    __inline void *_Nullable memalign(size_t alignment, size_t nb_bytes)
+    {
+        if (!alignment || (alignment & (alignment - 1))) {
+            errno = EINVAL;
+            return NULL;
+        }
+        
+        if (alignment <= MEMORY_ALIGNMENT)
+            return malloc(nb_bytes);
+        
+        if (!real_posix_memalign) initialize_overrides();
+        
+        if (!m_ArenaCount) {
+            void *ptr = NULL;
+            if (!real_posix_memalign)
+                return bootstrap_malloc(nb_bytes, alignment);
+            return real_posix_memalign(&ptr, alignment, nb_bytes) == 0 ? ptr : NULL;
         }
         
-        return Malloc(aligned_size);
+        if (RealtimeThread())
+            return RealtimeFailed();
+        
+        if (nb_bytes >= m_HugeThreshold)
+            return HugeMalloc(nb_bytes, alignment);
+        
+        size_t aligned_size = ALIGN_UP(nb_bytes, MEMORY_ALIGNMENT);
+        void *ptr = MallocAligned(aligned_size, alignment);
+        if (!ptr && GrowPool(BLOCK_SPAN(aligned_size) + alignment))
+            ptr = MallocAligned(aligned_size, alignment);
+        return ptr;
     }
     
     __inline void *_Nullable calloc(size_t count, size_t size)
     {
         if (!real_calloc) initialize_overrides();
         
-        if (m_Internal.load(std::memory_order_relaxed) || !m_MaxSize)
-            return real_calloc(count, size);
+        size_t total_size;
+        if (__builtin_mul_overflow(count, size, &total_size)) {
+            errno = ENOMEM;
+            return NULL;
+        }
+        
+        if (!m_ArenaCount)
+            return real_calloc ? real_calloc(count, size) : bootstrap_malloc(total_size, MEMORY_ALIGNMENT);
+        
+        if (total_size <= SLAB_MAX_SIZE || RealtimeThread()) {
+            void* ptr = malloc(total_size);
+            if (ptr)
+                memset(ptr, 0, total_size);
+            return ptr;
+        }
+        
+        // fresh mappings are already zero
+        if (total_size >= m_HugeThreshold)
+            return HugeMalloc(total_size, 0);
         
-        size_t total_size = count * size;
-        void* ptr = Malloc(total_size);
+        size_t aligned_size = ALIGN_UP(total_size, MEMORY_ALIGNMENT);
+        ZeroRange clean;
+        void* ptr = Malloc(aligned_size, &clean);
+        if (!ptr && GrowPool(BLOCK_SPAN(aligned_size)))
+            ptr = Malloc(aligned_size, &clean);
         
         if (ptr) {
-            // Clear the memory
-            memset(ptr, 0, total_size);
+            // Clear only what isn't known to be zero, in front of the clean range and past it
+            size_t begin = (int8_t*)ptr - m_Data, end = begin + total_size;
+            size_t clean_begin = std::min(std::max(clean.begin, begin), end);
+            size_t clean_end = std::max(std::min(clean.end, end), clean_begin);
+            memset(ptr, 0, clean_begin - begin);
+            memset(&m_Data[clean_end], 0, end - clean_end);
         }
         
         return ptr;
@@ -225,8 +1005,23 @@ public:
     {
         if (!real_free) initialize_overrides();
         
-        if (m_Internal.load(std::memory_order_relaxed) || !m_MaxSize || !p) {
-            real_free(p);
+        // Pool pointers are recognized by address, pool memory never goes to real_free
+        if (!IsPoolPointer(p)) {
+            // a real-time thread leaves the side table's lock and the munmap to another thread
+            if (RealtimeThread()) {
+                if (p)
+                    DeferFree(p);
+                return;
+            }
+            DrainDeferredFrees();
+            FreeOutside(p);
+            return;
+        }
+        
+        // Slab slots have no header, their slab is found through the page map
+        size_t slab = SlabOf(p);
+        if (slab != BLOCK_NIL) {
+            SlabFree(p, slab, SlabAt(slab)->sc);
             return;
         }
         
@@ -240,30 +1035,73 @@ public:
                 return;
             }
         }
-        // Not our pointer or not valid, use system free
-        real_free(p);
+        // Inside the pool but not a live block: a double free or a stray pointer
+        DEBUG_PRINTF(stderr, "WARNING: FreedomPool::free() invalid or double free of %p\n", p);
     }
     
     __inline void *_Nullable realloc(void *_Nullable p, size_t new_size)
     {
         if (!real_realloc) initialize_overrides();
         
-        if (m_Internal.load(std::memory_order_relaxed) || !m_MaxSize)
-            return real_realloc(p, new_size);
-        
         if (!p)
             return malloc(new_size);
         
+        if (!IsPoolPointer(p)) {
+            // resizing a mapping takes the side table's lock and a syscall, a real-time thread gets nothing
+            if (RealtimeThread())
+                return RealtimeFailed();
+            if (m_HugeCount && HugeSize(p))
+                return HugeRealloc(p, new_size);
+            size_t length = bootstrap_size(p);
+            if (length) {
+                // bootstrap memory moves to wherever malloc allocates now
+                void* new_p = malloc(new_size);
+                if (new_p)
+                    memcpy(new_p, p, std::min(length, new_size));
+                return new_p;
+            }
+            return real_realloc(p, new_size);
+        }
+        
+        size_t slab = SlabOf(p);
+        if (slab != BLOCK_NIL) {
+            // stay in the slot only while the size keeps its class, free_sized() relies on it
+            SlabHeader* sh = SlabAt(slab);
+            if (new_size <= sh->slot_size && SlabClass(new_size) == sh->sc)
+                return p;
+            
+            void* new_p = malloc(new_size);
+            if (!new_p)
+                return NULL;
+            
+            memcpy(new_p, p, std::min(new_size, (size_t)sh->slot_size));
+            SlabFree(p, slab, sh->sc);
+            return new_p;
+        }
+        
         if (IsValidPointer(p)) {
             // Only access the header if the pointer is valid
             BlockHeader* header = (BlockHeader*)((char*)p - sizeof(BlockHeader));
             if (header->token == TOKEN_ID) {
                 size_t old_size = header->size;
+                size_t aligned_size = ALIGN_UP(new_size, MEMORY_ALIGNMENT);
                 
-                // If the new size is smaller, we can just update the size
-                if (new_size <= old_size) {
-                    header->size = ALIGN_UP(new_size, MEMORY_ALIGNMENT);
-                    return p;
+                // A real-time thread doesn't take the lock, a smaller size just keeps the block
+                if (RealtimeThread()) {
+                    if (aligned_size <= old_size)
+                        return p;
+                } else {
+                    // Grow into a free next block or give the tail back, without moving
+                    Arena& arena = ArenaOf(header->offset);
+                    LockArena(arena);
+                    bool resized = ResizeBlock(arena, header->offset, BLOCK_SPAN(aligned_size));
+                    if (resized)
+                        header->size = aligned_size;
+                    arena.lock.unlock();
+                    if (resized) {
+                        StatResize(old_size, aligned_size);
+                        return p;
+                    }
                 }
                 
                 // Allocate new block
@@ -277,297 +1115,1970 @@ public:
                 return new_p;
             }
         }
-        return real_realloc(p, new_size);
+        DEBUG_PRINTF(stderr, "WARNING: FreedomPool::realloc() invalid pointer %p\n", p);
+        return NULL;
     }
     
-    __inline size_t malloc_size(const void *_Nullable p)
+    // Free with the size the block was allocated (or last reallocated) with, as C23 free_sized and
+    // C++14 sized delete do. A slab slot's class comes from the size, so it goes to the thread cache
+    // without touching the slab header. Blocks take the regular path, coalescing needs their header anyway.
+    __inline void free_sized(void *_Nullable p, size_t nb_bytes)
     {
-        if (!real_malloc_size) initialize_overrides();
+        if (nb_bytes > SLAB_MAX_SIZE || !IsPoolPointer(p)) {
+            free(p);
+            return;
+        }
         
-        if (m_Internal.load(std::memory_order_relaxed) || !m_MaxSize || !p)
-            return real_malloc_size(p);
+        size_t slab = SlabOf(p);
+        if (slab == BLOCK_NIL) {
+            free(p);
+            return;
+        }
         
-        if (IsValidPointer(p)) {
-            // Only access the header if the pointer is valid
-            BlockHeader* header = (BlockHeader*)((char*)p - sizeof(BlockHeader));
-            if (header->token == TOKEN_ID) {
-                return header->size;
-            }
+        size_t sc = SlabClass(nb_bytes);
+#ifdef FREEDOM_DEBUG
+        if (SlabAt(slab)->sc != sc) {
+            DEBUG_PRINTF(stderr, "WARNING: FreedomPool::free_sized() size %zu does not match the slot of %p\n", nb_bytes, p);
+            sc = SlabAt(slab)->sc;
         }
-        return real_malloc_size(p);
+#endif
+        SlabFree(p, slab, sc);
     }
     
-    __inline size_t malloc_usable_size(const void *_Nullable p)
+    // Grow an allocation in place to max_size, or to at least min_size, never moving it (like xallocx).
+    // Returns the usable size afterwards, which is the old one if the block could not grow far enough.
+    __inline size_t try_expand(void *_Nullable p, size_t min_size, size_t max_size)
     {
-        if (!real_malloc_usable_size) initialize_overrides();
+        if (!p || !IsPoolPointer(p)) {
+            size_t length = m_HugeCount ? HugeSize(p) : 0;
+            size_t page = (size_t)getpagesize();
+            if (max_size < min_size)
+                max_size = min_size;
+            if (length && max_size > length && max_size <= SIZE_MAX - page && !RealtimeThread()) {
+                // only ever extend the mapping, to max_size or failing that to min_size
+                size_t want = ALIGN_UP(max_size, page);
+                size_t need = ALIGN_UP(min_size, page);
+                if (HugeResize(p, length, want) || (need > length && HugeResize(p, length, need)))
+                    length = HugeSize(p);
+            }
+            return length ? length : malloc_usable_size(p);
+        }
         
-        if (m_Internal.load(std::memory_order_relaxed) || !m_MaxSize || !p)
-            return real_malloc_usable_size(p);
+        size_t slab = SlabOf(p);
+        if (slab != BLOCK_NIL)
+            return SlabAt(slab)->slot_size;
         
-        if (IsValidPointer(p)) {
-            // Only access the header if the pointer is valid
-            BlockHeader* header = (BlockHeader*)((char*)p - sizeof(BlockHeader));
-            if (header->token == TOKEN_ID) {
+        if (!IsValidPointer(p))
+            return 0;
+        
+        BlockHeader* header = (BlockHeader*)((char*)p - sizeof(BlockHeader));
+        if (header->token != TOKEN_ID)
+            return 0;
+        if (RealtimeThread())
+            return header->size;
+        
+        Arena& arena = ArenaOf(header->offset);
+        LockArena(arena);
+        size_t size = header->size;
+        if (max_size < min_size)
+            max_size = min_size;
+        if (max_size > size) {
+            // the most we can reach is our own span plus a free next block
+            size_t span = header->span & BLOCK_SPAN_MASK;
+            BlockHeader* next = HeaderAt(header->offset + span);
+            size_t avail = span - sizeof(BlockHeader);
+            if (next->span & BLOCK_FREE)
+                avail += next->span & BLOCK_SPAN_MASK;
+            
+            // as far toward max_size as it goes, as long as that reaches min_size
+            size_t target = ALIGN_UP(std::min(max_size, avail), MEMORY_ALIGNMENT);
+            if (target > size && target >= min_size && ResizeBlock(arena, header->offset, BLOCK_SPAN(target))) {
+                StatResize(size, target);
+                header->size = target;
+                size = target;
+            }
+        }
+        arena.lock.unlock();
+        return size;
+    }
+    
+    // Allocate count blocks of nb_bytes each into out, taking each arena's lock once and carving
+    // consecutive blocks out of one free region. Returns how many were allocated, less than count only when out of memory.
+    __inline size_t malloc_batch(size_t nb_bytes, size_t count, void *_Nullable *_Nonnull out)
+    {
+        if (!real_malloc) initialize_overrides();
+        
+        size_t taken = 0;
+        if (!m_ArenaCount || nb_bytes >= m_HugeThreshold || RealtimeThread()) {
+            while (taken < count && (out[taken] = malloc(nb_bytes)))
+                taken++;
+            return taken;
+        }
+        
+        size_t home = HomeArena();
+        
+        if (nb_bytes <= SLAB_MAX_SIZE) {
+            size_t sc = SlabClass(nb_bytes);
+            for (size_t i = 0; i < m_ArenaCount && taken < count; i++) {
+                Arena& arena = m_Arenas[(home + i) % m_ArenaCount];
+                LockArena(arena);
+                taken += SlabAllocSlots(arena, sc, count - taken, &out[taken]);
+                arena.lock.unlock();
+            }
+            
+            // new slabs are carved SLAB_SIZE aligned, one more slab covers the alignment
+            size_t slabs = (count - taken + SlabSlotCount(sc) - 1) / SlabSlotCount(sc);
+            if (taken < count && GrowPool(SLAB_SIZE * (slabs + 1))) {
+                for (size_t i = 0; i < m_ArenaCount && taken < count; i++) {
+                    Arena& arena = m_Arenas[(home + i) % m_ArenaCount];
+                    LockArena(arena);
+                    taken += SlabAllocSlots(arena, sc, count - taken, &out[taken]);
+                    arena.lock.unlock();
+                }
+            }
+            StatAlloc(sc, SlabSlotSize(sc) * taken, taken);
+            return taken;
+        }
+        
+        size_t aligned_size = ALIGN_UP(nb_bytes, MEMORY_ALIGNMENT);
+        for (size_t i = 0; i < m_ArenaCount && taken < count; i++)
+            taken += ArenaMallocBatch(m_Arenas[(home + i) % m_ArenaCount], aligned_size, count - taken, &out[taken]);
+        
+        // growth may have gone to another arena than home
+        if (taken < count && GrowPool(BLOCK_SPAN(aligned_size) * (count - taken))) {
+            for (size_t i = 0; i < m_ArenaCount && taken < count; i++)
+                taken += ArenaMallocBatch(m_Arenas[(home + i) % m_ArenaCount], aligned_size, count - taken, &out[taken]);
+        }
+        return taken;
+    }
+    
+    // Free count pointers at once. The array is sorted in place so each arena's lock is taken once
+    // and runs of neighbouring blocks go back to the free lists as a single block.
+    __inline void free_batch(void *_Nullable *_Nonnull ptrs, size_t count)
+    {
+        if (!real_free) initialize_overrides();
+        
+        if (RealtimeThread()) {
+            for (size_t i = 0; i < count; i++)
+                free(ptrs[i]);
+            return;
+        }
+        
+        std::sort(ptrs, ptrs + count);
+        
+        size_t i = 0;
+        while (i < count) {
+            if (!IsPoolPointer(ptrs[i])) {
+                free(ptrs[i++]);
+                continue;
+            }
+            
+            // pool pointers of one arena are contiguous once sorted
+            Arena& arena = ArenaOf((int8_t*)ptrs[i] - m_Data);
+            size_t end = i + 1;
+            while (end < count && IsPoolPointer(ptrs[end]) && &ArenaOf((int8_t*)ptrs[end] - m_Data) == &arena)
+                end++;
+            
+            LockArena(arena);
+            FreeBatch(arena, &ptrs[i], end - i);
+            arena.lock.unlock();
+            i = end;
+        }
+    }
+    
+    __inline size_t malloc_size(const void *_Nullable p)
+    {
+        if (!real_malloc_size) initialize_overrides();
+        
+        if (!IsPoolPointer(p)) {
+            size_t length = m_HugeCount ? HugeSize(p) : 0;
+            if (!length)
+                length = bootstrap_size(p);
+            return length ? length : real_malloc_size(p);
+        }
+        
+        size_t slab = SlabOf(p);
+        if (slab != BLOCK_NIL)
+            return SlabAt(slab)->slot_size;
+        
+        if (IsValidPointer(p)) {
+            // Only access the header if the pointer is valid
+            BlockHeader* header = (BlockHeader*)((char*)p - sizeof(BlockHeader));
+            if (header->token == TOKEN_ID) {
+                return header->size;
+            }
+        }
+        return 0;
+    }
+    
+    __inline size_t malloc_usable_size(const void *_Nullable p)
+    {
+        if (!real_malloc_usable_size) initialize_overrides();
+        
+        if (!IsPoolPointer(p)) {
+            size_t length = m_HugeCount ? HugeSize(p) : 0;
+            if (!length)
+                length = bootstrap_size(p);
+            return length ? length : real_malloc_usable_size(p);
+        }
+        
+        size_t slab = SlabOf(p);
+        if (slab != BLOCK_NIL)
+            return SlabAt(slab)->slot_size;
+        
+        if (IsValidPointer(p)) {
+            // Only access the header if the pointer is valid
+            BlockHeader* header = (BlockHeader*)((char*)p - sizeof(BlockHeader));
+            if (header->token == TOKEN_ID) {
                 return header->size;
             }
         }
-        return real_malloc_usable_size(p);
+        return 0;
+    }
+    
+    // Extend the memory pool, that is the calling thread's arena
+    size_t ExtendPool(size_t ExtraSize)
+    {
+        if (!m_ArenaCount)
+            return 0;
+        ExtendArena(m_Arenas[HomeArena()], ExtraSize);
+        return GetMaxSize();
+    }
+    
+protected:
+    // One independent slice of the pool. Offsets are still relative to m_Data,
+    // so the arena owning any offset is simply offset / m_ArenaSpan.
+    struct alignas(64) Arena {
+        AtomicLock  lock;                                   // guards everything below
+        size_t      base;                                   // offset of the slice in m_Data
+        size_t      size;                                   // committed bytes, the last block is the sentinel
+        size_t      free_size;                              // bytes in free blocks
+        
+        // TLSF index: bitmaps of non-empty bins plus the bin list heads, the lists
+        // themselves are linked through the free blocks (FreeLinks) inside m_Data
+        uint64_t    fl_bitmap;                              // bit per first level with any non-empty bin
+        uint32_t    sl_bitmap[TLSF_FL_COUNT];               // bit per non-empty second level bin
+        size_t      bins[TLSF_FL_COUNT][TLSF_SL_COUNT];     // offset of the first free block per bin
+        
+        size_t      slab_partial[SLAB_CLASS_COUNT];         // per class list of slabs with free slots
+        
+        size_t      alloc_count;                            // Number of allocations
+        size_t      free_count;                             // Number of frees
+        size_t      free_blocks;                            // blocks in the bins
+        size_t      used_peak;                              // high-water mark of size - free_size
+        size_t      lock_count;                             // lock acquisitions
+        size_t      lock_contended;                         // acquisitions that had to wait
+        uint64_t    lock_wait_ns;                           // total time waited
+        size_t      purged;                                 // bytes of free pages released so far
+        int         node;                                   // NUMA node the slice is bound to, -1 for none
+        size_t      rover;                                  // next fit: free block the last allocation was split from
+        
+        alignas(64) std::atomic<RemoteFree*> remote_head;   // frees queued by other threads, own cache line
+        std::atomic<size_t> remote_count;                   // entries pushed since the last drain
+    };
+    
+    __inline Arena& ArenaOf(size_t offset) { return m_Arenas[offset / m_ArenaSpan]; }
+    
+    // Lock an arena for allocating, first taking in whatever other threads queued for it.
+    // Only an acquisition that finds the lock taken is timed
+    __inline void LockArena(Arena& arena)
+    {
+        if (arena.lock.trylock() != 0) {
+            uint64_t start = StatClock();
+            arena.lock.lock();
+            arena.lock_wait_ns += StatClock() - start;
+            arena.lock_contended++;
+        }
+        arena.lock_count++;
+        if (arena.remote_head.load(std::memory_order_relaxed))
+            DrainRemoteFrees(arena);
+    }
+    
+    // True if a free can be done inline: the arena is the thread's own and its lock is free.
+    // Otherwise the caller queues it, so freeing never waits for another thread.
+    __inline bool TryLockForFree(Arena& arena)
+    {
+        if (&arena != &m_Arenas[HomeArena()] || arena.lock.trylock() != 0)
+            return false;
+        arena.lock_count++;
+        return true;
+    }
+    
+    // Take bytes off the arena's free space, following the high-water mark of its use
+    __inline void TakeFree(Arena& arena, size_t bytes)
+    {
+        arena.free_size -= bytes;
+        arena.used_peak = std::max(arena.used_peak, arena.size - arena.free_size);
+    }
+    
+    // Head of the highest non-empty bin, must be called with the arena's lock held. O(1) however long
+    // the bin is, and every block of the bin is within the bin's width of it (1 / 2^TLSF_SL_LOG2)
+    size_t LargestFreeBlock(Arena& arena)
+    {
+        if (!arena.fl_bitmap)
+            return 0;
+        int fl = 63 - __builtin_clzll(arena.fl_bitmap);
+        int sl = 31 - __builtin_clz(arena.sl_bitmap[fl]);
+        return HeaderAt(arena.bins[fl][sl])->span & BLOCK_SPAN_MASK;
+    }
+    
+    __inline static uint64_t StatClock()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+    
+    // Index of the calling thread's statistics shard, handed out round-robin
+    __inline static size_t StatShardIndex()
+    {
+        static thread_local size_t shard = 0;       // shard index + 1, 0 until assigned
+        static std::atomic<size_t> next(0);
+        if (!shard)
+            shard = next++ % STATS_SHARDS + 1;
+        return shard - 1;
+    }
+    
+    __inline void StatAlloc(size_t sc, size_t bytes, size_t count = 1)
+    {
+#ifndef DISABLE_STATS
+        StatShard& shard = m_Stats[StatShardIndex()];
+        shard.allocs[sc].fetch_add(count, std::memory_order_relaxed);
+        shard.alloc_bytes.fetch_add(bytes, std::memory_order_relaxed);
+#endif
+    }
+    
+    __inline void StatFree(size_t sc, size_t bytes, size_t count = 1)
+    {
+#ifndef DISABLE_STATS
+        StatShard& shard = m_Stats[StatShardIndex()];
+        shard.frees[sc].fetch_add(count, std::memory_order_relaxed);
+        shard.free_bytes.fetch_add(bytes, std::memory_order_relaxed);
+#endif
+    }
+    
+    // An allocation resized in place is neither an alloc nor a free, only the bytes move
+    __inline void StatResize(size_t oldSize, size_t newSize)
+    {
+#ifndef DISABLE_STATS
+        StatShard& shard = m_Stats[StatShardIndex()];
+        if (newSize > oldSize)
+            shard.alloc_bytes.fetch_add(newSize - oldSize, std::memory_order_relaxed);
+        else
+            shard.free_bytes.fetch_add(oldSize - newSize, std::memory_order_relaxed);
+#endif
+    }
+    
+    static void *_Nullable StatsDumpThread(void *_Nonnull arg)
+    {
+        FreedomPool* pool = (FreedomPool*)arg;
+        while (pool->m_DumpSema.wait(pool->m_DumpInterval) != 0)
+            pool->DumpStats(stderr, pool->m_DumpJson);
+        return NULL;
+    }
+    
+    // Every wake-up is a purge tick, blocks freed PURGE_TICKS ticks ago are released
+    static void *_Nullable DecayPurgeThread(void *_Nonnull arg)
+    {
+        FreedomPool* pool = (FreedomPool*)arg;
+        while (pool->m_PurgeSema.wait(pool->m_PurgeInterval) != 0) {
+            pool->DrainDeferredFrees();
+            pool->m_PurgeTick.fetch_add(1, std::memory_order_relaxed);
+            for (size_t i = 0; i < pool->m_ArenaCount; i++)
+                pool->PurgeArena(pool->m_Arenas[i], PURGE_TICKS);
+        }
+        return NULL;
+    }
+    
+    // Take up to count free blocks of at least PURGE_MIN_SIZE, freed age ticks ago or earlier and not
+    // purged yet, off their bins and flag them used. The search goes on from bin (fl, sl) and leaves it
+    // there, the next call only rescans that bin. Must be called with the arena's lock held
+    size_t TakePurgeable(Arena& arena, uint64_t tick, uint64_t age, int& fl, int& sl, size_t *_Nonnull out, size_t count)
+    {
+        size_t taken = 0;
+        for (; fl < TLSF_FL_COUNT; fl++, sl = 0) {
+            uint32_t sl_map = arena.sl_bitmap[fl] & (~0U << sl);
+            while (sl_map) {
+                sl = __builtin_ctz(sl_map);
+                sl_map &= sl_map - 1;
+                size_t offset = arena.bins[fl][sl];
+                while (offset != BLOCK_NIL) {
+                    size_t next = LinksAt(offset)->next;
+                    uint64_t stamp = LinksAt(offset)->stamp;
+                    if (stamp != PURGE_DONE && stamp + age <= tick) {
+                        BlockHeader* header = HeaderAt(offset);
+                        size_t size = header->span & BLOCK_SPAN_MASK;
+                        RemoveFromBin(arena, offset, size);
+                        header->span = size;
+                        HeaderAt(offset + size)->span &= ~BLOCK_PREV_FREE;
+                        arena.free_size -= size;
+                        out[taken++] = offset;
+                        if (taken == count)
+                            return taken;
+                    }
+                    offset = next;
+                }
+            }
+        }
+        return taken;
+    }
+    
+    // Release the pages inside an arena's old free blocks, returns the bytes released.
+    // Blocks are taken off their bins and flagged used a batch at a time while madvise runs
+    // without the lock, so neither an allocation nor a neighbour coalescing can touch them meanwhile.
+    // Put back purged or merged with a newer neighbour, they aren't taken again in this pass
+    size_t PurgeArena(Arena& arena, uint64_t age)
+    {
+        size_t page = m_PageSize;
+        uint64_t tick = m_PurgeTick.load(std::memory_order_relaxed);
+        size_t released = 0;
+        size_t blocks[PURGE_BATCH], sizes[PURGE_BATCH], zeros[PURGE_BATCH];
+        int fl, sl;
+        MappingInsert(std::max((size_t)PURGE_MIN_SIZE, m_PageSize), fl, sl);
+        
+        LockArena(arena);
+        size_t count;
+        while ((count = TakePurgeable(arena, tick, age, fl, sl, blocks, PURGE_BATCH)) > 0) {
+            // a neighbour freed meanwhile sets BLOCK_PREV_FREE in the header, the sizes are read now
+            for (size_t i = 0; i < count; i++)
+                sizes[i] = HeaderAt(blocks[i])->span;
+            arena.lock.unlock();
+            
+            for (size_t i = 0; i < count; i++) {
+                size_t offset = blocks[i];
+                size_t size = sizes[i];
+                
+                // the header, bin links and boundary tag stay, whole pages between them go
+                // hugetlbfs pages were set aside for the pool, giving them back saves nothing
+                size_t from = std::max(offset + BLOCK_FREE_META, m_HugeTlbSize);
+                uintptr_t start = ALIGN_UP((uintptr_t)&m_Data[from], page);
+                uintptr_t end = ALIGN_DOWN((uintptr_t)&m_Data[offset + size - sizeof(size_t)], page);
+                zeros[i] = BLOCK_NIL;
+                if (end > start && madvise((void*)start, end - start, PURGE_ADVICE) == 0) {
+                    released += end - start;
+                    
+                    // clearing the partial pages at both ends makes the block zero for calloc from there on
+                    if (PURGE_ZEROES) {
+                        memset(&m_Data[from], 0, start - (uintptr_t)&m_Data[from]);
+                        memset((void*)end, 0, (uintptr_t)&m_Data[offset + size - sizeof(size_t)] - end);
+                        zeros[i] = from;
+                    }
+                }
+            }
+            
+            LockArena(arena);
+            for (size_t i = 0; i < count; i++) {
+                size_t offset = blocks[i];
+                size_t size = sizes[i];
+                BlockHeader* header = HeaderAt(offset);
+                arena.free_size += size;
+                AddFreeBlock(arena, offset, size, zeros[i]);
+                
+                // unless a neighbour was freed meanwhile and merged in, the block is purged as a whole
+                if (header->span == (size | BLOCK_FREE))
+                    LinksAt(offset)->stamp = PURGE_DONE;
+            }
+        }
+        arena.purged += released;
+        arena.lock.unlock();
+        return released;
+    }
+    
+    // Queue a free on the arena with a single CAS. A long queue is drained here
+    // if the arena happens to be free, otherwise by its next allocation
+    void PushRemoteFree(Arena& arena, void *_Nonnull ptr, bool drain = true)
+    {
+        RemoteFree* node = (RemoteFree*)ptr;
+        RemoteFree* head = arena.remote_head.load(std::memory_order_relaxed);
+        do {
+            node->next = head;
+        } while (!arena.remote_head.compare_exchange_weak(head, node, std::memory_order_release, std::memory_order_relaxed));
+        
+        if (arena.remote_count.fetch_add(1, std::memory_order_relaxed) + 1 >= REMOTE_FREE_BATCH && drain && arena.lock.trylock() == 0) {
+            DrainRemoteFrees(arena);
+            arena.lock.unlock();
+        }
+    }
+    
+    // Take the whole remote free stack at once and free its entries, must be called with the arena's lock held
+    void DrainRemoteFrees(Arena& arena)
+    {
+        arena.remote_count.store(0, std::memory_order_relaxed);
+        RemoteFree* node = arena.remote_head.exchange(NULL, std::memory_order_acquire);
+        while (node) {
+            RemoteFree* next = node->next;
+            size_t offset = (int8_t*)node - m_Data;
+            if (m_PageMap[offset >> SLAB_SHIFT] == PAGE_SLAB)
+                SlabFreeSlot(arena, offset);
+            else
+                FreeBlock(arena, offset - sizeof(BlockHeader));
+            node = next;
+        }
+    }
+    
+    void InitArena(Arena& arena, size_t base, int node)
+    {
+        arena.lock.init();
+        arena.base = base;
+        arena.size = 0;
+        arena.free_size = 0;
+        arena.alloc_count = 0;
+        arena.free_count = 0;
+        arena.free_blocks = 0;
+        arena.used_peak = 0;
+        arena.lock_count = 0;
+        arena.lock_contended = 0;
+        arena.lock_wait_ns = 0;
+        arena.purged = 0;
+        arena.node = node;
+        arena.rover = BLOCK_NIL;
+        arena.remote_head.store(NULL, std::memory_order_relaxed);
+        arena.remote_count.store(0, std::memory_order_relaxed);
+        
+        // Initialize the bins, all empty
+        arena.fl_bitmap = 0;
+        for (int i = 0; i < TLSF_FL_COUNT; i++) {
+            arena.sl_bitmap[i] = 0;
+            for (int j = 0; j < TLSF_SL_COUNT; j++)
+                arena.bins[i][j] = BLOCK_NIL;
+        }
+        for (int i = 0; i < SLAB_CLASS_COUNT; i++) {
+            arena.slab_partial[i] = BLOCK_NIL;
+        }
+        
+#ifdef __linux__
+        // Prefer the node's memory for the whole slice, pages are placed as they are first touched
+        if (node >= 0) {
+            unsigned long mask = 1UL << node;
+            syscall(SYS_mbind, m_Data + base, m_ArenaSpan, 1 /* MPOL_PREFERRED */, &mask, sizeof(mask) * 8 + 1, 0);
+        }
+#endif
+    }
+    
+    // Number of NUMA nodes, from /sys/devices/system/node/online ("0" or "0-3"). Reads
+    // with plain syscalls as we may be inside the first malloc; 1 where there's no NUMA
+    static size_t CountNumaNodes()
+    {
+#ifdef __linux__
+        char buf[64];
+        int fd = open("/sys/devices/system/node/online", O_RDONLY);
+        if (fd < 0)
+            return 1;
+        ssize_t len = read(fd, buf, sizeof(buf) - 1);
+        close(fd);
+        if (len <= 0)
+            return 1;
+        buf[len] = 0;
+        
+        // the last number in the list is the highest node
+        size_t last = 0, number = 0;
+        for (ssize_t i = 0; i < len; i++) {
+            if (buf[i] >= '0' && buf[i] <= '9') {
+                number = number * 10 + (buf[i] - '0');
+                last = number;
+            } else {
+                number = 0;
+            }
+        }
+        return last + 1;
+#else
+        return 1;
+#endif
+    }
+    
+#ifdef FREEDOM_HUGE_PAGES
+    // Bytes of 2 MB pages hugetlbfs can still hand out, free ones not promised to another mapping.
+    // Same plain syscalls as CountNumaNodes, 0 where hugetlbfs has none
+    static size_t HugeTlbAvailable()
+    {
+        static const char *const files[2] = {
+            "/sys/kernel/mm/hugepages/hugepages-2048kB/free_hugepages",
+            "/sys/kernel/mm/hugepages/hugepages-2048kB/resv_hugepages"
+        };
+        size_t pages[2];
+        for (int i = 0; i < 2; i++) {
+            char buf[32];
+            int fd = open(files[i], O_RDONLY);
+            if (fd < 0)
+                return 0;
+            ssize_t len = read(fd, buf, sizeof(buf) - 1);
+            close(fd);
+            if (len <= 0)
+                return 0;
+            pages[i] = 0;
+            for (ssize_t k = 0; k < len && buf[k] >= '0' && buf[k] <= '9'; k++)
+                pages[i] = pages[i] * 10 + (buf[k] - '0');
+        }
+        return pages[0] > pages[1] ? (pages[0] - pages[1]) * HUGE_PAGE_SIZE : 0;
+    }
+#endif
+    
+    // Index of the calling thread's arena: the one of its NUMA node, or round-robin. The thread's
+    // cache remembers it for the first pool that asks, or for the pool the cache is bound to.
+    // Other pools the thread uses meanwhile place it by a hash of the thread, which is as stable
+    __inline size_t HomeArena()
+    {
+        ThreadCache& cache = GetThreadCache();
+        if (cache.home_pool == this)
+            return cache.home % m_ArenaCount;
+        if (cache.home_pool && cache.owner != this)
+            return (size_t)(((uintptr_t)&cache * UINT64_C(0x9E3779B97F4A7C15)) >> 32) % m_ArenaCount;
+        
+        size_t home;
+#ifdef __linux__
+        unsigned cpu, node;
+        if (m_NumaNodes > 1 && syscall(SYS_getcpu, &cpu, &node, NULL) == 0)
+            home = node;
+        else
+#endif
+        home = m_NextArena++;
+        cache.home_pool = this;
+        cache.home = home;
+        return home % m_ArenaCount;
+    }
+    
+    // Commit ExtraSize more bytes at the end of an arena's slice
+    size_t ExtendArena(Arena& arena, size_t ExtraSize)
+    {
+#ifdef FREEDOM_STACK_ALLOC
+        if (arena.size) {
+            fprintf(stderr, "FreedomPool isn't allowed to extend past initial size in static allocation. Set to %zu MB\n", ExtraSize/MBYTE);
+            return arena.size;
+        }
+#endif
+        LockArena(arena);
+        
+#ifdef FREEDOM_STACK_ALLOC
+        // Ensure extra size is aligned
+        ExtraSize = ALIGN_UP(ExtraSize, MEMORY_ALIGNMENT);
+        if (ExtraSize < BLOCK_SENTINEL_SPAN + BLOCK_MIN_SPAN) {
+            fprintf(stderr, "FreedomPool arena of %zu bytes can't hold a block and its sentinel\n", ExtraSize);
+            arena.lock.unlock();
+            return arena.size;
+        }
+#else
+        // Commit whole pages of the reserve, the data itself stays where it is
+        ExtraSize = ALIGN_UP(ExtraSize, m_PageSize);
+        if (!m_Data || ExtraSize > m_ArenaSpan - arena.size ||
+            mprotect(m_Data + arena.base + arena.size, ExtraSize, PROT_READ | PROT_WRITE) != 0) {
+            fprintf(stderr, "FreedomPool couldn't commit %zu MB more, %zu of %zu MB reserved in use\n", ExtraSize/MBYTE, arena.size/MBYTE, m_ArenaSpan/MBYTE);
+            arena.lock.unlock();
+            return arena.size;
+        }
+#endif
+        
+#ifndef FREEDOM_PRELOAD
+        // preloaded into programs that don't know about the pool, keep their stderr clean
+        fprintf(stderr, "Expanding FreedomPool arena %zu internal size to: %zu MB\n", arena.base / m_ArenaSpan, (arena.size + ExtraSize)/MBYTE);
+#endif
+        
+        // Each arena always ends with a used sentinel header, so coalescing never looks
+        // past the end. On growth the old sentinel becomes the start of the new free block.
+        size_t NewBlockOffset, NewBlockSize;
+        if (!arena.size) {
+            NewBlockOffset = arena.base;
+            NewBlockSize = ExtraSize - BLOCK_SENTINEL_SPAN;
+            HeaderAt(arena.base)->span = 0;
+        } else {
+            NewBlockOffset = arena.base + arena.size - BLOCK_SENTINEL_SPAN;
+            NewBlockSize = ExtraSize;
+        }
+        
+        size_t end = arena.base + arena.size + ExtraSize;
+        BlockHeader* sentinel = HeaderAt(end - BLOCK_SENTINEL_SPAN);
+        sentinel->span = BLOCK_SENTINEL_SPAN;
+        sentinel->size = 0;
+        sentinel->token = 0;
+        sentinel->offset = end - BLOCK_SENTINEL_SPAN;
+        
+        // Add the block directly to the free list, past its metadata it is as the kernel gave it
+        AddFreeBlock(arena, NewBlockOffset, NewBlockSize, m_FreshZero ? NewBlockOffset + BLOCK_FREE_META : BLOCK_NIL);
+        
+        arena.size += ExtraSize;
+        arena.free_size += NewBlockSize;
+        
+        arena.lock.unlock();
+        return arena.size;
+    }
+    
+    // Grow the pool after a request of span bytes found no fit in any arena. Growth commits more
+    // of the calling thread's slice in place, so it happens right away, or of the next slice with
+    // reserve left once the thread's own is fully committed. The static model can't grow
+    bool GrowPool(size_t span)
+    {
+#ifdef FREEDOM_STACK_ALLOC
+        (void)span;
+        return false;
+#else
+        // enough for the request to be found past the TLSF bin rounding, plus some headroom
+        size_t grow = span + (span >> TLSF_SL_LOG2) + GROW_INCREMENT;
+        if (grow < span)
+            return false;
+        DEBUG_PRINTF(stderr, "FreedomPool::malloc() Ran out of space allocating %lld MB used %lld of %lld MB, expanding by %lld MB\n", span/MBYTE, GetUsedSize()/MBYTE, GetMaxSize()/MBYTE, grow/MBYTE);
+        size_t home = HomeArena();
+        for (size_t i = 0; i < m_ArenaCount; i++) {
+            Arena& arena = m_Arenas[(home + i) % m_ArenaCount];
+            size_t before = arena.size;
+            if (ALIGN_UP(grow, m_PageSize) > m_ArenaSpan - before && i + 1 < m_ArenaCount)
+                continue;       // full slice, don't let ExtendArena complain about every one of them
+            if (ExtendArena(arena, grow) > before)
+                return true;
+        }
+        return false;
+#endif
+    }
+    
+    // Per-thread cache of slab slots, each class is an intrusive list linked
+    // through the cached slots themselves
+    struct ThreadCache {
+        FreedomPool *_Nullable  owner;
+        uint64_t                generation;             // owner's, tells it from a pool later built at its address
+        void *_Nullable         head[SLAB_CLASS_COUNT];
+        uint32_t                count[SLAB_CLASS_COUNT];
+        bool                    realtime;               // RegisterRealtimeThread(), never refilled or flushed
+        size_t                  failures;               // real-time allocations the cache couldn't serve
+        FreedomPool *_Nullable  home_pool;              // pool home is the thread's arena in, see HomeArena()
+        size_t                  home;                   // NUMA node or round-robin number, taken modulo the arena count
+    };
+    
+    // Plain aggregate, so the thread_local needs no constructor and is safe to touch from inside malloc
+    __inline static ThreadCache& GetThreadCache()
+    {
+        static thread_local ThreadCache cache;
+        return cache;
+    }
+    
+    // Unique per pool instance of the type, 0 is no pool
+    __inline static uint64_t NextGeneration()
+    {
+        static std::atomic<uint64_t> generation(0);
+        return generation.fetch_add(1, std::memory_order_relaxed) + 1;
+    }
+    
+    __inline bool OwnsThreadCache(const ThreadCache& cache) const
+    {
+        return cache.owner == this && cache.generation == m_Generation;
+    }
+    
+    // Forget the cached slots without returning them, they belong to a destroyed pool
+    __inline static void ResetThreadCache(ThreadCache& cache)
+    {
+        memset(cache.head, 0, sizeof(cache.head));
+        memset(cache.count, 0, sizeof(cache.count));
+        cache.owner = NULL;
+        cache.generation = 0;
+        cache.realtime = false;
+    }
+    
+    // A thread caches for the first pool it allocates from, other pools go straight to the slabs.
+    // A cache left over from a destroyed pool at this address is dropped
+    __inline bool BindThreadCache(ThreadCache& cache)
+    {
+        if (cache.owner == this) {
+            if (cache.generation == m_Generation)
+                return true;
+            ResetThreadCache(cache);
+        }
+        if (cache.owner)
+            return false;
+        cache.owner = this;
+        cache.generation = m_Generation;
+        pthread_setspecific(m_CacheKey, &cache);
+        return true;
+    }
+    
+    __inline void *_Nullable CacheAlloc(ThreadCache& cache, size_t sc)
+    {
+        if (!cache.head[sc] && (cache.realtime || !RefillThreadCache(cache, sc)))
+            return NULL;
+        
+        void *ptr = cache.head[sc];
+        cache.head[sc] = *(void**)ptr;
+        cache.count[sc]--;
+        return ptr;
+    }
+    
+    // The slot may have come from another thread's cache, that's fine -
+    // cached slots stay allocated as far as their slab is concerned
+    __inline void CacheFree(ThreadCache& cache, size_t sc, void *_Nonnull ptr)
+    {
+        *(void**)ptr = cache.head[sc];
+        cache.head[sc] = ptr;
+        
+        if (++cache.count[sc] > THREAD_CACHE_DEPTH && !cache.realtime)
+            FlushThreadCache(cache, sc, THREAD_CACHE_DEPTH / 2);
+    }
+    
+    // Pull a batch of slots into the cache with a single lock round-trip,
+    // from the thread's own arena unless it is out of space
+    bool RefillThreadCache(ThreadCache& cache, size_t sc)
+    {
+        void *slots[THREAD_CACHE_BATCH];
+        size_t count = 0;
+        
+        size_t home = HomeArena();
+        for (size_t i = 0; i < m_ArenaCount && !count; i++) {
+            Arena& arena = m_Arenas[(home + i) % m_ArenaCount];
+            LockArena(arena);
+            count = SlabAllocSlots(arena, sc, THREAD_CACHE_BATCH, slots);
+            arena.lock.unlock();
+        }
+        
+        for (size_t i = 0; i < count; i++) {
+            *(void**)slots[i] = cache.head[sc];
+            cache.head[sc] = slots[i];
+        }
+        cache.count[sc] += count;
+        return count > 0;
+    }
+    
+    // Return up to count slots of a class to their slabs. Cached slots may come from
+    // several arenas, the lock is only switched when the arena changes
+    void FlushThreadCache(ThreadCache& cache, size_t sc, size_t count)
+    {
+        Arena *locked = NULL;
+        
+        while (count-- && cache.head[sc]) {
+            void *ptr = cache.head[sc];
+            cache.head[sc] = *(void**)ptr;
+            cache.count[sc]--;
+            
+            size_t offset = (int8_t*)ptr - m_Data;
+            Arena *arena = &ArenaOf(offset);
+            if (arena != locked) {
+                if (locked)
+                    locked->lock.unlock();
+                LockArena(*arena);
+                locked = arena;
+            }
+            SlabFreeSlot(*arena, offset);
+        }
+        
+        if (locked)
+            locked->lock.unlock();
+    }
+    
+    void FlushThreadCache(ThreadCache& cache)
+    {
+        for (size_t sc = 0; sc < SLAB_CLASS_COUNT; sc++) {
+            if (cache.head[sc])
+                FlushThreadCache(cache, sc, cache.count[sc]);
+        }
+        cache.owner = NULL;
+    }
+    
+    static void ReleaseThreadCache(void *_Nullable arg)
+    {
+        ThreadCache *cache = (ThreadCache*)arg;
+        if (cache && cache->owner) {
+            cache->realtime = false;
+            cache->owner->FlushThreadCache(*cache);
+        }
+    }
+    
+    // True if the calling thread registered as real-time with this pool
+    __inline bool RealtimeThread()
+    {
+#ifndef DISABLE_THREAD_CACHE
+        ThreadCache& cache = GetThreadCache();
+        return cache.realtime && OwnsThreadCache(cache);
+#else
+        return false;
+#endif
+    }
+    
+    __inline void *_Nullable RealtimeFailed()
+    {
+#ifndef DISABLE_THREAD_CACHE
+        GetThreadCache().failures++;
+#endif
+        errno = ENOMEM;
+        return NULL;
+    }
+    
+    // Slab class of a small request: 8 steps of MEMORY_ALIGNMENT (16..128 by 16), then four classes per power of two
+    __inline static constexpr size_t SlabClass(size_t size)
+    {
+        if (size <= 8 * MEMORY_ALIGNMENT)
+            return size ? (size - 1) / MEMORY_ALIGNMENT : 0;
+        int lg = 63 - __builtin_clzll(size - 1);
+        return 8 + (lg - 3 - TLSF_ALIGN_LOG2) * 4 + ((size - 1) >> (lg - 2)) - 4;
+    }
+    
+    __inline static constexpr size_t SlabSlotSize(size_t sc)
+    {
+        if (sc < 8)
+            return (sc + 1) * MEMORY_ALIGNMENT;
+        size_t base = (size_t)(8 * MEMORY_ALIGNMENT) << ((sc - 8) / 4);
+        return base + ((sc - 8) % 4 + 1) * (base / 4);
+    }
+    
+    // Offset of the first slot in a slab, past its headers, and the slots a slab of a class holds
+    __inline static constexpr size_t SlabFirstSlot()
+    {
+        return ALIGN_UP(sizeof(BlockHeader) + sizeof(SlabHeader), std::max(64, MEMORY_ALIGNMENT));
+    }
+    
+    __inline static constexpr size_t SlabSlotCount(size_t sc) { return (SLAB_SIZE - SlabFirstSlot()) / SlabSlotSize(sc); }
+    
+    __inline SlabHeader *_Nonnull SlabAt(size_t slab) { return (SlabHeader*)&m_Data[slab + sizeof(BlockHeader)]; }
+    
+    // Slab a pool pointer belongs to, or BLOCK_NIL for the best-fit pages
+    __inline size_t SlabOf(const void *_Nonnull p) const
+    {
+        size_t offset = (const int8_t*)p - m_Data;
+        return m_PageMap[offset >> SLAB_SHIFT] == PAGE_SLAB ? ALIGN_DOWN(offset, SLAB_SIZE) : BLOCK_NIL;
+    }
+    
+    __inline void *_Nullable SlabMalloc(size_t sc)
+    {
+        void *ptr = NULL;
+#ifndef DISABLE_THREAD_CACHE
+        ThreadCache& cache = GetThreadCache();
+        if (BindThreadCache(cache))
+            ptr = CacheAlloc(cache, sc);
+        else
+#endif
+        {
+            size_t home = HomeArena();
+            for (size_t i = 0; i < m_ArenaCount && !ptr; i++) {
+                Arena& arena = m_Arenas[(home + i) % m_ArenaCount];
+                LockArena(arena);
+                SlabAllocSlots(arena, sc, 1, &ptr);
+                arena.lock.unlock();
+            }
+        }
+        if (ptr)
+            StatAlloc(sc, SlabSlotSize(sc));
+        return ptr;
+    }
+    
+    __inline void SlabFree(void *_Nonnull p, size_t slab, size_t sc)
+    {
+        StatFree(sc, SlabSlotSize(sc));
+#ifndef DISABLE_THREAD_CACHE
+        ThreadCache& cache = GetThreadCache();
+        if (BindThreadCache(cache)) {
+            CacheFree(cache, sc, p);
+            return;
+        }
+#endif
+        Arena& arena = ArenaOf(slab);
+        if (!TryLockForFree(arena)) {
+            PushRemoteFree(arena, p);
+            return;
+        }
+        SlabFreeSlot(arena, (int8_t*)p - m_Data);
+        arena.lock.unlock();
+    }
+    
+    // Hand out up to count slots of a class, filling partial slabs first.
+    // Must be called with the arena's lock held, returns the number of slots taken.
+    size_t SlabAllocSlots(Arena& arena, size_t sc, size_t count, void *_Nullable *_Nonnull out)
+    {
+        size_t taken = 0;
+        
+        while (taken < count) {
+            size_t slab = arena.slab_partial[sc];
+            if (slab == BLOCK_NIL && (slab = NewSlab(arena, sc)) == BLOCK_NIL)
+                break;
+            
+            SlabHeader* sh = SlabAt(slab);
+            while (taken < count && sh->free_count) {
+                while (!sh->bitmap[sh->hint])
+                    sh->hint++;
+                
+                uint64_t& word = sh->bitmap[sh->hint];
+                size_t slot = sh->hint * 64 + __builtin_ctzll(word);
+                word &= word - 1;
+                
+                out[taken++] = &m_Data[slab + sh->first + slot * sh->slot_size];
+                sh->free_count--;
+            }
+            if (!sh->free_count)
+                UnlinkSlab(arena, slab);
+        }
+        return taken;
+    }
+    
+    // Put a slot back into its slab's bitmap, must be called with the arena's lock held.
+    // A slab that becomes entirely free goes back to the pool unless it is the last one of its class.
+    void SlabFreeSlot(Arena& arena, size_t offset)
+    {
+        size_t slab = ALIGN_DOWN(offset, SLAB_SIZE);
+        SlabHeader* sh = SlabAt(slab);
+        
+        size_t rel = offset - slab - sh->first;
+        size_t slot = rel / sh->slot_size;
+        if (offset < slab + sh->first || slot * sh->slot_size != rel || slot >= sh->slot_count ||
+            (sh->bitmap[slot / 64] & (1ULL << (slot % 64)))) {
+            DEBUG_PRINTF(stderr, "WARNING: FreedomPool::free() invalid or double free of slab slot %p\n", &m_Data[offset]);
+            return;
+        }
+        
+        sh->bitmap[slot / 64] |= 1ULL << (slot % 64);
+        sh->hint = std::min(sh->hint, (uint32_t)(slot / 64));
+        
+        if (sh->free_count++ == 0)
+            LinkSlab(arena, slab);
+        
+        if (sh->free_count == sh->slot_count && (sh->prev != BLOCK_NIL || sh->next != BLOCK_NIL)) {
+            UnlinkSlab(arena, slab);
+            m_PageMap[slab >> SLAB_SHIFT] = PAGE_BLOCKS;
+            
+            BlockHeader* header = HeaderAt(slab);
+            size_t span = header->span & BLOCK_SPAN_MASK;
+            header->token = 0;
+            AddFreeBlock(arena, slab, span);
+            arena.free_size += span;
+            arena.free_count++;
+        }
+    }
+    
+    // Carve a new SLAB_SIZE aligned slab for a class out of the arena, must be called with its lock held
+    size_t NewSlab(Arena& arena, size_t sc)
+    {
+        size_t slab;
+        if (!CarveAligned(arena, SLAB_SIZE, SLAB_SIZE, 0, slab))
+            return BLOCK_NIL;
+        
+        HeaderAt(slab)->token = TOKEN_SLAB;
+        m_PageMap[slab >> SLAB_SHIFT] = PAGE_SLAB;
+        
+        SlabHeader* sh = SlabAt(slab);
+        sh->slot_size = (uint32_t)SlabSlotSize(sc);
+        sh->sc = (uint32_t)sc;
+        sh->first = (uint32_t)SlabFirstSlot();
+        sh->slot_count = (uint32_t)SlabSlotCount(sc);
+        sh->free_count = sh->slot_count;
+        sh->hint = 0;
+        
+        for (size_t i = 0; i < SLAB_BITMAP_WORDS; i++) {
+            size_t bits = std::min(std::max((ssize_t)sh->slot_count - (ssize_t)(i * 64), (ssize_t)0), (ssize_t)64);
+            sh->bitmap[i] = bits == 64 ? ~0ULL : (1ULL << bits) - 1;
+        }
+        
+        LinkSlab(arena, slab);
+        return slab;
+    }
+    
+    void LinkSlab(Arena& arena, size_t slab)
+    {
+        SlabHeader* sh = SlabAt(slab);
+        sh->prev = BLOCK_NIL;
+        sh->next = arena.slab_partial[sh->sc];
+        if (sh->next != BLOCK_NIL)
+            SlabAt(sh->next)->prev = slab;
+        arena.slab_partial[sh->sc] = slab;
+    }
+    
+    void UnlinkSlab(Arena& arena, size_t slab)
+    {
+        SlabHeader* sh = SlabAt(slab);
+        if (sh->prev != BLOCK_NIL)
+            SlabAt(sh->prev)->next = sh->next;
+        else
+            arena.slab_partial[sh->sc] = sh->next;
+        if (sh->next != BLOCK_NIL)
+            SlabAt(sh->next)->prev = sh->prev;
+        sh->prev = sh->next = BLOCK_NIL;
+    }
+    
+    // Take a block of span bytes whose offset + skew is a multiple of align, splitting off
+    // the front gap and the tail as free blocks. Must be called with the arena's lock held.
+    bool CarveAligned(Arena& arena, size_t span, size_t align, size_t skew, size_t& result)
+    {
+        size_t offset, blockSize;
+        if (!FindFit(arena, span + align + BLOCK_MIN_SPAN, offset, blockSize))
+            return false;
+        
+        // the gap in front must be either empty or big enough to be a free block of its own
+        size_t aligned = ALIGN_UP(offset + skew, align) - skew;
+        while (aligned != offset && aligned - offset < BLOCK_MIN_SPAN)
+            aligned += align;
+        size_t gap = aligned - offset;
+        
+        size_t zero = LinksAt(offset)->zero;
+        size_t kept = SplitBlock(arena, aligned, blockSize - gap, span, zero);
+        SetBlockUsed(aligned, kept, 0);
+        
+        // the gap goes back last, it flags our header with BLOCK_PREV_FREE
+        if (gap)
+            InsertFreeBlock(arena, offset, gap, ZeroTail(zero, offset, gap));
+        
+        TakeFree(arena, kept);
+        arena.alloc_count++;
+        
+        result = aligned;
+        return true;
+    }
+    
+    // One page map byte per SLAB_SIZE page of the reserve, the last one possibly partial
+    __inline size_t PageMapSize() const { return ALIGN_UP(m_Reserved, SLAB_SIZE) >> SLAB_SHIFT; }
+    
+    __inline BlockHeader *_Nonnull HeaderAt(size_t offset) { return (BlockHeader*)&m_Data[offset]; }
+    __inline FreeLinks *_Nonnull LinksAt(size_t offset) { return (FreeLinks*)&m_Data[offset + sizeof(BlockHeader)]; }
+    
+    // Mark a block as allocated, the block before it is never free (free blocks are always coalesced)
+    __inline void SetBlockUsed(size_t offset, size_t span, size_t requestedSize)
+    {
+        BlockHeader* header = HeaderAt(offset);
+        header->span = span;
+        header->size = requestedSize;
+        header->offset = offset;
+        header->token = TOKEN_ID;
+    }
+    
+    // Keep the first span bytes of a free block just taken off its bin and give the rest back,
+    // with the part of the block's zero tail it holds. A remainder too small to be a block
+    // stays attached, returns the span actually kept.
+    size_t SplitBlock(Arena& arena, size_t offset, size_t blockSize, size_t span, size_t zero = BLOCK_NIL)
+    {
+        if (blockSize - span >= BLOCK_MIN_SPAN) {
+            // the block after the remainder already has BLOCK_PREV_FREE set
+            InsertFreeBlock(arena, offset + span, blockSize - span, ZeroTail(zero, offset + span, blockSize - span));
+            SetRover(arena, offset + span, Placement());
+            return span;
+        }
+        HeaderAt(offset + blockSize)->span &= ~BLOCK_PREV_FREE;
+        return blockSize;
+    }
+    
+    // Map a huge allocation directly, over-mapping and trimming for alignments above the page size
+    void *_Nullable HugeMalloc(size_t size, size_t alignment)
+    {
+        DrainDeferredFrees();
+        
+        size_t page = (size_t)getpagesize();
+        size_t length = ALIGN_UP(size, page);
+#ifdef FREEDOM_HUGE_PAGES
+        // start on a huge page so transparent huge pages can back all of it
+        if (length >= HUGE_PAGE_SIZE)
+            alignment = std::max(alignment, (size_t)HUGE_PAGE_SIZE);
+#endif
+        size_t extra = alignment > page ? alignment - page : 0;
+        if (length < size || length + extra < length)
+            return NULL;
+        
+        char* base = (char*)mmap(NULL, length + extra, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON, -1, 0);
+        if (base == MAP_FAILED) {
+            DEBUG_PRINTF(stderr, "FreedomPool::HugeMalloc() mmap of %zu MB failed\n", length / MBYTE);
+            return NULL;
+        }
+        if (extra) {
+            char* aligned = (char*)ALIGN_UP((uintptr_t)base, alignment);
+            size_t head = aligned - base;
+            if (head)
+                munmap(base, head);
+            if (extra - head)
+                munmap(aligned + length, extra - head);
+            base = aligned;
+        }
+#ifdef FREEDOM_HUGE_PAGES
+        if (length >= HUGE_PAGE_SIZE)
+            madvise(base, length, MADV_HUGEPAGE);
+#endif
+        
+        m_HugeLock.lock();
+        bool inserted = HugeInsert(base, length);
+        m_HugeLock.unlock();
+        
+        if (!inserted) {
+            munmap(base, length);
+            return NULL;
+        }
+        StatAlloc(STAT_HUGE, length);
+        return base;
+    }
+    
+    // Free memory that isn't the pool's: a huge mapping, the bootstrap heap (never freed) or the system's
+    __inline void FreeOutside(void *_Nullable p)
+    {
+        if ((!m_HugeCount || !HugeFree(p)) && !bootstrap_size(p))
+            real_free(p);
+    }
+    
+    // Real-time threads queue their frees of memory outside the pool, linked through the memory
+    // itself with a single CAS, until a thread that may lock and unmap releases them
+    void DeferFree(void *_Nonnull p)
+    {
+        RemoteFree* node = (RemoteFree*)p;
+        RemoteFree* head = m_DeferredFrees.load(std::memory_order_relaxed);
+        do {
+            node->next = head;
+        } while (!m_DeferredFrees.compare_exchange_weak(head, node, std::memory_order_release, std::memory_order_relaxed));
+    }
+    
+    // Release the queued frees, called by frees and maps outside the pool, Trim and the decay purger
+    void DrainDeferredFrees()
+    {
+        if (!m_DeferredFrees.load(std::memory_order_relaxed) || RealtimeThread())
+            return;
+        RemoteFree* node = m_DeferredFrees.exchange(NULL, std::memory_order_acquire);
+        while (node) {
+            RemoteFree* next = node->next;
+            FreeOutside(node);
+            node = next;
+        }
+    }
+    
+    // Unmap a huge allocation, false if the pointer isn't one
+    bool HugeFree(void *_Nullable p)
+    {
+        m_HugeLock.lock();
+        size_t length = HugeErase(p);
+        m_HugeLock.unlock();
+        
+        if (!length)
+            return false;
+        munmap(p, length);
+        StatFree(STAT_HUGE, length);
+        return true;
+    }
+    
+    // Length of the huge mapping starting at p, 0 if there is none
+    size_t HugeSize(const void *_Nullable p)
+    {
+        m_HugeLock.lock();
+        HugeEntry* entry = HugeFind(p);
+        size_t length = entry ? entry->size : 0;
+        m_HugeLock.unlock();
+        return length;
+    }
+    
+    // Resize a huge mapping without moving it, false if the pages right after it are taken
+    bool HugeResize(void *_Nonnull p, size_t length, size_t newLength)
+    {
+        if (newLength == length)
+            return true;
+        
+        if (newLength < length) {
+            munmap((char*)p + newLength, length - newLength);
+        } else {
+#ifdef __linux__
+            if (mremap(p, length, newLength, 0) == MAP_FAILED)
+                return false;
+#else
+            char* want = (char*)p + length;
+            void* tail = mmap(want, newLength - length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON, -1, 0);
+            if (tail == MAP_FAILED)
+                return false;
+            if (tail != want) {
+                munmap(tail, newLength - length);
+                return false;
+            }
+#endif
+        }
+        
+        m_HugeLock.lock();
+        HugeFind(p)->size = newLength;
+        m_HugeBytes += newLength - length;
+        m_HugePeak = std::max(m_HugePeak, m_HugeBytes);
+        m_HugeLock.unlock();
+        StatResize(length, newLength);
+        return true;
     }
     
-    // Extend the memory pool
-    size_t ExtendPool(size_t ExtraSize)
+    // Huge realloc never copies on Linux: the mapping is resized in place or moved by mremap.
+    // Elsewhere it is extended in place when the next pages are free, otherwise mapped anew and copied.
+    void *_Nullable HugeRealloc(void *_Nonnull p, size_t size)
     {
-#ifdef FREEDOM_STACK_ALLOC
-        if (m_MaxSize) {
-            fprintf(stderr, "FreedomPool isn't allowed to extend past initial size in static allocation. Set to %zu MB\n", ExtraSize/MBYTE);
-            return m_MaxSize;
+        size_t length = HugeSize(p);
+        
+        // shrunk below the threshold, back into the pool
+        if (size < m_HugeThreshold) {
+            void* new_p = malloc(size);
+            if (!new_p)
+                return NULL;
+            memcpy(new_p, p, std::min(length, size));
+            HugeFree(p);
+            return new_p;
         }
+        
+        size_t newLength = ALIGN_UP(size, (size_t)getpagesize());
+        if (newLength < size)
+            return NULL;
+        if (HugeResize(p, length, newLength))
+            return p;
+        
+#ifdef __linux__
+        void* new_p = mremap(p, length, newLength, MREMAP_MAYMOVE);
+        if (new_p == MAP_FAILED)
+            return NULL;
+        
+        m_HugeLock.lock();
+        HugeErase(p);
+        HugeInsert(new_p, newLength);   // can't fail, an entry was just erased
+        m_HugeLock.unlock();
+        StatResize(length, newLength);
+#else
+        void* new_p = HugeMalloc(size, 0);
+        if (!new_p)
+            return NULL;
+        memcpy(new_p, p, length);
+        HugeFree(p);
 #endif
-        m_Lock.lock();
+        return new_p;
+    }
+    
+    // Side table slot a mapping hashes to, m_HugeCapacity is a power of two
+    __inline size_t HugeSlot(const void *_Nullable p) const
+    {
+        return (size_t)((((uintptr_t)p >> 12) * UINT64_C(0x9E3779B97F4A7C15)) >> 32) & (m_HugeCapacity - 1);
+    }
+    
+    // Look up a huge mapping, must be called with m_HugeLock held
+    HugeEntry *_Nullable HugeFind(const void *_Nullable p)
+    {
+        if (!m_HugeCount || !p)
+            return NULL;
+        for (size_t i = HugeSlot(p); m_HugeTable[i].ptr; i = (i + 1) & (m_HugeCapacity - 1)) {
+            if (m_HugeTable[i].ptr == p)
+                return &m_HugeTable[i];
+        }
+        return NULL;
+    }
+    
+    // Add a huge mapping, growing the table past half full. Must be called with m_HugeLock held
+    bool HugeInsert(void *_Nonnull p, size_t length)
+    {
+        if ((m_HugeCount + 1) * 2 > m_HugeCapacity) {
+            size_t capacity = m_HugeCapacity ? m_HugeCapacity * 2 : HUGE_TABLE_MIN;
+            HugeEntry* table = (HugeEntry*)mmap(NULL, capacity * sizeof(HugeEntry), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON, -1, 0);
+            if (table == MAP_FAILED)
+                return false;
+            
+            HugeEntry* old = m_HugeTable;
+            size_t oldCapacity = m_HugeCapacity;
+            m_HugeTable = table;        // fresh anonymous pages are zero, all slots empty
+            m_HugeCapacity = capacity;
+            for (size_t i = 0; i < oldCapacity; i++) {
+                if (old[i].ptr) {
+                    size_t j = HugeSlot(old[i].ptr);
+                    while (table[j].ptr)
+                        j = (j + 1) & (capacity - 1);
+                    table[j] = old[i];
+                }
+            }
+            if (old)
+                munmap(old, oldCapacity * sizeof(HugeEntry));
+        }
         
-        // Ensure extra size is aligned
-        ExtraSize = ALIGN_UP(ExtraSize, MEMORY_ALIGNMENT);
+        size_t i = HugeSlot(p);
+        while (m_HugeTable[i].ptr)
+            i = (i + 1) & (m_HugeCapacity - 1);
+        m_HugeTable[i].ptr = p;
+        m_HugeTable[i].size = length;
+        m_HugeCount++;
+        m_HugeBytes += length;
+        m_HugePeak = std::max(m_HugePeak, m_HugeBytes);
+        return true;
+    }
+    
+    // Remove a huge mapping and return its length (0 if unknown), shifting the following
+    // entries back so that no probe chain is broken. Must be called with m_HugeLock held
+    size_t HugeErase(const void *_Nullable p)
+    {
+        HugeEntry* entry = HugeFind(p);
+        if (!entry)
+            return 0;
         
-        size_t NewBlockOffset = m_MaxSize;
-        size_t NewBlockSize = ExtraSize;
+        size_t length = entry->size;
+        size_t mask = m_HugeCapacity - 1;
+        size_t i = entry - m_HugeTable;
+        for (size_t j = (i + 1) & mask; m_HugeTable[j].ptr; j = (j + 1) & mask) {
+            // entry j can move into the hole at i unless its home slot lies cyclically in (i, j]
+            size_t k = HugeSlot(m_HugeTable[j].ptr);
+            if (i <= j ? (i < k && k <= j) : (i < k || k <= j))
+                continue;
+            m_HugeTable[i] = m_HugeTable[j];
+            i = j;
+        }
+        m_HugeTable[i].ptr = NULL;
+        m_HugeTable[i].size = 0;
+        m_HugeCount--;
+        m_HugeBytes -= length;
+        return length;
+    }
+    
+    // Resize a used block where it is: grow by absorbing the free block that follows it,
+    // or split the tail off and give it back. Returns false if the next block can't cover the growth.
+    bool ResizeBlock(Arena& arena, size_t offset, size_t span)
+    {
+        BlockHeader* header = HeaderAt(offset);
+        size_t blockSize = header->span & BLOCK_SPAN_MASK;
+        size_t flags = header->span & BLOCK_PREV_FREE;
         
-        fprintf(stderr, "Expanding FreedomPool internal size to: %zu MB\n", (m_MaxSize + ExtraSize)/MBYTE);
+        if (span > blockSize) {
+            BlockHeader* next = HeaderAt(offset + blockSize);
+            size_t nextSize = next->span & BLOCK_SPAN_MASK;
+            if (!(next->span & BLOCK_FREE) || blockSize + nextSize < span)
+                return false;
+            
+            RemoveFromBin(arena, offset + blockSize, nextSize);
+            size_t kept = SplitBlock(arena, offset, blockSize + nextSize, span, LinksAt(offset + blockSize)->zero);
+            header->span = kept | flags;
+            TakeFree(arena, kept - blockSize);
+            return true;
+        }
         
-        // Add the block directly to the free list
-        AddFreeBlock(NewBlockOffset, NewBlockSize);
+        if (blockSize - span >= BLOCK_MIN_SPAN) {
+            // the tail's previous block is us and stays in use
+            HeaderAt(offset + span)->span = 0;
+            header->span = span | flags;
+            AddFreeBlock(arena, offset + span, blockSize - span);
+            arena.free_size += blockSize - span;
+        }
+        return true;
+    }
+    
+    // Add a free block to its TLSF bin, coalescing with free neighbours through the
+    // boundary tags. The block's own header must be valid, its BLOCK_PREV_FREE bit is honoured.
+    // zero is where the block starts reading zero, see FreeLinks
+    void AddFreeBlock(Arena& arena, size_t offset, size_t size, size_t zero = BLOCK_NIL)
+    {
+        // Check for coalescence with previous block, its span is in the word before our header
+        if (HeaderAt(offset)->span & BLOCK_PREV_FREE) {
+            size_t prevSize = *(size_t*)&m_Data[offset - sizeof(size_t)];
+            size_t prevZero = LinksAt(offset - prevSize)->zero;
+            RemoveFromBin(arena, offset - prevSize, prevSize);
+            zero = JoinZero(offset, prevZero, zero);
+            offset -= prevSize;
+            size += prevSize;
+        }
         
-        m_MaxSize += ExtraSize;
-        m_FreeSize += ExtraSize;
+        // Check for coalescence with next block
+        BlockHeader* next = HeaderAt(offset + size);
+        if (next->span & BLOCK_FREE) {
+            size_t nextSize = next->span & BLOCK_SPAN_MASK;
+            RemoveFromBin(arena, offset + size, nextSize);
+            zero = JoinZero(offset + size, zero, LinksAt(offset + size)->zero);
+            size += nextSize;
+        }
         
-#ifndef FREEDOM_STACK_ALLOC
-        if (!m_Data)
-            m_Data = (int8_t*)real_malloc(m_MaxSize);
+        InsertFreeBlock(arena, offset, size, zero);
+    }
+    
+    // Zero tail of two free blocks joined at seam: the second one's, unless it is zero right past its
+    // metadata and the first has a zero tail too. Then the boundary tag and metadata between them are
+    // cleared, and the joined block reads zero from where the first one did
+    size_t JoinZero(size_t seam, size_t first, size_t second)
+    {
+        // second == BLOCK_NIL is tested on its own, seam + BLOCK_FREE_META can wrap around to it
+        if (first == BLOCK_NIL || second == BLOCK_NIL || second != seam + BLOCK_FREE_META)
+            return second;
+        assert(seam >= BLOCK_MIN_SPAN);     // the first block and its boundary tag lie before the seam
+        int8_t* tag = m_Data + seam - sizeof(size_t);
+        memset(tag, 0, sizeof(size_t) + BLOCK_FREE_META);
+        return first;
+    }
+    
+    // The part of a zero tail that falls in the free block at offset, past its own metadata
+    __inline static size_t ZeroTail(size_t zero, size_t offset, size_t size)
+    {
+        if (zero == BLOCK_NIL || zero >= offset + size - sizeof(size_t))
+            return BLOCK_NIL;
+        return std::max(zero, offset + BLOCK_FREE_META);
+    }
+    
+    // Write the free block's header and boundary tag and push it onto its bin
+    void InsertFreeBlock(Arena& arena, size_t offset, size_t size, size_t zero = BLOCK_NIL)
+    {
+        BlockHeader* header = HeaderAt(offset);
+        header->span = size | BLOCK_FREE;
+        header->size = 0;
+        header->token = 0;
+        header->offset = offset;
+        *(size_t*)&m_Data[offset + size - sizeof(size_t)] = size;
+        HeaderAt(offset + size)->span |= BLOCK_PREV_FREE;
+        LinksAt(offset)->stamp = m_PurgeTick.load(std::memory_order_relaxed);
+        LinksAt(offset)->zero = zero;
+        
+        AddToBin(arena, offset, size);
+    }
+    
+    // Map a block size to its bin: first level is the power of two,
+    // second level splits it linearly into TLSF_SL_COUNT sub-classes
+    __inline static void MappingInsert(size_t size, int& fl, int& sl)
+    {
+        if (size < TLSF_SMALL_BLOCK) {
+            fl = 0;
+            sl = (int)(size / (TLSF_SMALL_BLOCK / TLSF_SL_COUNT));
+        } else {
+            int msb = 63 - __builtin_clzll(size);
+            sl = (int)(size >> (msb - TLSF_SL_LOG2)) ^ TLSF_SL_COUNT;
+            fl = msb - (TLSF_FL_SHIFT - 1);
+        }
+    }
+    
+    // Round the request up to the next bin boundary so that any block in the bin found fits
+    __inline static bool MappingSearch(size_t size, int& fl, int& sl)
+    {
+        if (size >= TLSF_SMALL_BLOCK) {
+            size_t round = ((size_t)1 << (63 - __builtin_clzll(size) - TLSF_SL_LOG2)) - 1;
+            if (size > SIZE_MAX - round)
+                return false;
+            size += round;
+        }
+        MappingInsert(size, fl, sl);
+        return fl < TLSF_FL_COUNT;
+    }
+    
+    // Locate the first non-empty bin at or above (fl, sl) with find-first-set on the bitmaps
+    __inline static bool FindSuitableBin(const Arena& arena, int& fl, int& sl)
+    {
+        uint32_t sl_map = arena.sl_bitmap[fl] & (~0U << sl);
+        if (!sl_map) {
+            uint64_t fl_map = (fl + 1 < 64) ? arena.fl_bitmap & (~0ULL << (fl + 1)) : 0;
+            if (!fl_map)
+                return false;
+            fl = __builtin_ctzll(fl_map);
+            sl_map = arena.sl_bitmap[fl];
+        }
+        sl = __builtin_ctz(sl_map);
+        return true;
+    }
+    
+    // Unlink a free block from its bin list
+    void RemoveFromBin(Arena& arena, size_t offset, size_t size)
+    {
+        int fl, sl;
+        MappingInsert(size, fl, sl);
+        
+        FreeLinks* links = LinksAt(offset);
+        if (links->prev != BLOCK_NIL)
+            LinksAt(links->prev)->next = links->next;
         else
-            m_Data = (int8_t*)real_realloc(m_Data, m_MaxSize);
-#endif
+            arena.bins[fl][sl] = links->next;
+        if (links->next != BLOCK_NIL)
+            LinksAt(links->next)->prev = links->prev;
+        arena.free_blocks--;
+        ForgetRover(arena, offset, Placement());
         
-        m_Lock.unlock();
-        return m_MaxSize;
+        if (arena.bins[fl][sl] == BLOCK_NIL) {
+            arena.sl_bitmap[fl] &= ~(1U << sl);
+            if (!arena.sl_bitmap[fl])
+                arena.fl_bitmap &= ~(1ULL << fl);
+        }
     }
     
-protected:
-    // Add a free block to the appropriate size class
-     void AddFreeBlock(size_t offset, size_t size)
-     {
-         // Ensure offset and size are aligned
-         offset = ALIGN_UP(offset, MEMORY_ALIGNMENT);
-         size = ALIGN_DOWN(size, MEMORY_ALIGNMENT);
-         
-         if (size == 0)
-             return;
-         
-         // Store block by address for coalescing
-         auto it = m_FreeBlocksByOffset.lower_bound(offset);
-         
-         // Check for coalescence with previous block
-         if (it != m_FreeBlocksByOffset.begin()) {
-             auto prev = std::prev(it);
-             if (prev->first + prev->second == offset) {
-                 // Coalesce with previous block
-                 size_t prevSize = prev->second;
-                 size_t prevOffset = prev->first;
-                 
-                 // Remove previous block from its size class
-                 RemoveFromSizeClass(prevSize, prevOffset);
-                 
-                 // Extend size
-                 size += prevSize;
-                 offset = prevOffset;
-                 
-                 // Remove previous from address map
-                 m_FreeBlocksByOffset.erase(prev);
-             }
-         }
-         
-         // Check for coalescence with next block
-         if (it != m_FreeBlocksByOffset.end() && offset + size == it->first) {
-             // Coalesce with next block
-             size_t nextSize = it->second;
-             size_t nextOffset = it->first;
-             
-             // Remove next block from its size class
-             RemoveFromSizeClass(nextSize, nextOffset);
-             
-             // Extend size
-             size += nextSize;
-             
-             // Remove next from address map
-             m_FreeBlocksByOffset.erase(it);
-         }
-         
-         // Add the block to the address map
-         m_FreeBlocksByOffset[offset] = size;
-         
-         // Add to appropriate size class
-         AddToSizeClass(size, offset);
-     }
-    
-    // Remove a block from its size class
-      void RemoveFromSizeClass(size_t size, size_t offset)
-      {
-          int sizeClass = GET_SIZE_CLASS(size);
-          auto& blocks = m_SizeClasses[sizeClass];
-          
-          for (auto it = blocks.begin(); it != blocks.end(); ++it) {
-              if (it->first == offset) {
-                  blocks.erase(it);
-                  return;
-              }
-          }
-      }
-    // Add a block to its size class
-       void AddToSizeClass(size_t size, size_t offset)
-       {
-           int sizeClass = GET_SIZE_CLASS(size);
-           m_SizeClasses[sizeClass].push_back(std::make_pair(offset, size));
-       }
-       
-    
-    // Find the best fit block in the size classes
-       bool FindBestFit(size_t size, size_t& offset, size_t& blockSize)
-       {
-           // Start with the size class that would fit this size
-           int sizeClass = GET_SIZE_CLASS(size);
-           
-           // Look in this size class and larger ones
-           for (int sc = sizeClass; sc < SIZE_CLASS_COUNT; sc++) {
-               auto& blocks = m_SizeClasses[sc];
-               
-               // Find the best fit in this size class
-               size_t bestFitSize = SIZE_MAX;
-               size_t bestFitOffset = 0;
-               size_t bestFitIndex = SIZE_MAX;
-               
-               for (size_t i = 0; i < blocks.size(); i++) {
-                   if (blocks[i].second >= size && blocks[i].second < bestFitSize) {
-                       bestFitSize = blocks[i].second;
-                       bestFitOffset = blocks[i].first;
-                       bestFitIndex = i;
-                   }
-               }
-               
-               if (bestFitIndex != SIZE_MAX) {
-                   // Found a block
-                   offset = bestFitOffset;
-                   blockSize = bestFitSize;
-                   
-                   // Remove from size class
-                   blocks.erase(blocks.begin() + bestFitIndex);
-                   
-                   // Remove from address map
-                   m_FreeBlocksByOffset.erase(offset);
-                   
-                   return true;
-               }
-           }
-           
-           return false;
-       }
-    
-    // Allocate memory from the pool
-    void *_Nullable Malloc(size_t requestedSize)
-    {
-        m_Lock.trylock();
-        m_Internal.store(true, std::memory_order_relaxed);
+    // Link a free block into its bin list, at the head unless the placement policy keeps an order
+    void AddToBin(Arena& arena, size_t offset, size_t size)
+    {
+        int fl, sl;
+        MappingInsert(size, fl, sl);
+        
+        size_t prev = BinPredecessor(arena, arena.bins[fl][sl], offset, Placement());
+        FreeLinks* links = LinksAt(offset);
+        links->prev = prev;
+        links->next = prev == BLOCK_NIL ? arena.bins[fl][sl] : LinksAt(prev)->next;
+        if (links->next != BLOCK_NIL)
+            LinksAt(links->next)->prev = offset;
+        if (prev == BLOCK_NIL)
+            arena.bins[fl][sl] = offset;
+        else
+            LinksAt(prev)->next = offset;
+        arena.free_blocks++;
+        
+        arena.sl_bitmap[fl] |= 1U << sl;
+        arena.fl_bitmap |= 1ULL << fl;
+    }
+    
+    // Bins stay LIFO, except in address order for first fit: the block goes after the last one below it
+    template <typename Policy>
+    __inline size_t BinPredecessor(Arena&, size_t, size_t, Policy) { return BLOCK_NIL; }
+    
+    __inline size_t BinPredecessor(Arena&, size_t head, size_t offset, PlacementFirstFit)
+    {
+        size_t prev = BLOCK_NIL;
+        for (size_t at = head; at != BLOCK_NIL && at < offset; at = LinksAt(at)->next)
+            prev = at;
+        return prev;
+    }
+    
+    // Only next fit keeps a rover, it always names a free block in a bin or BLOCK_NIL
+    template <typename Policy>
+    __inline void SetRover(Arena&, size_t, Policy) {}
+    template <typename Policy>
+    __inline void ForgetRover(Arena&, size_t, Policy) {}
+    
+    __inline void SetRover(Arena& arena, size_t offset, PlacementNextFit) { arena.rover = offset; }
+    __inline void ForgetRover(Arena& arena, size_t offset, PlacementNextFit)
+    {
+        if (arena.rover == offset)
+            arena.rover = BLOCK_NIL;
+    }
+    
+    // Find a free block of at least size bytes with the pool's placement policy and take it off the free lists
+    __inline bool FindFit(Arena& arena, size_t size, size_t& offset, size_t& blockSize)
+    {
+        if (!FindFit(arena, size, offset, Placement()))
+            return false;
+        
+        blockSize = HeaderAt(offset)->span & BLOCK_SPAN_MASK;
+        RemoveFromBin(arena, offset, blockSize);
+        return true;
+    }
+    
+    __inline bool FindFit(Arena& arena, size_t size, size_t& offset, PlacementGoodFit)
+    {
+        int fl, sl;
+        if (!MappingSearch(size, fl, sl) || !FindSuitableBin(arena, fl, sl))
+            return false;
+        
+        // every block in the bin found is large enough, take the most recently freed one
+        offset = arena.bins[fl][sl];
+        return true;
+    }
+    
+    // Good fit rounds the request up past its own bin, whose blocks may be just as good a fit
+    bool FindFit(Arena& arena, size_t size, size_t& offset, PlacementBoundedFit)
+    {
+        int fl, sl;
+        MappingInsert(size, fl, sl);
+        
+        size_t tried = 0;
+        for (size_t at = arena.bins[fl][sl]; at != BLOCK_NIL && tried < PLACEMENT_SEARCH_LIMIT; at = LinksAt(at)->next, tried++) {
+            if ((HeaderAt(at)->span & BLOCK_SPAN_MASK) >= size) {
+                offset = at;
+                return true;
+            }
+        }
+        return FindFit(arena, size, offset, PlacementGoodFit());
+    }
+    
+    // The request's own bin holds blocks on both sides of its size, every block of a bin above
+    // fits and is larger than any of it, so the smallest fit is in one of the two
+    bool FindFit(Arena& arena, size_t size, size_t& offset, PlacementBestFit)
+    {
+        int fl, sl;
+        MappingInsert(size, fl, sl);
         
+        offset = SmallestFit(arena.bins[fl][sl], size);
+        if (offset != BLOCK_NIL)
+            return true;
+        
+        if (!NextBin(fl, sl) || !FindSuitableBin(arena, fl, sl))
+            return false;
+        offset = SmallestFit(arena.bins[fl][sl], size);
+        return true;
+    }
+    
+    // Bins are in address order, so the candidates are the first fit of the request's own bin
+    // and the head of every non-empty bin above it
+    bool FindFit(Arena& arena, size_t size, size_t& offset, PlacementFirstFit)
+    {
+        int fl, sl;
+        MappingInsert(size, fl, sl);
+        
+        offset = BLOCK_NIL;
+        for (size_t at = arena.bins[fl][sl]; at != BLOCK_NIL; at = LinksAt(at)->next) {
+            if ((HeaderAt(at)->span & BLOCK_SPAN_MASK) >= size) {
+                offset = at;
+                break;
+            }
+        }
+        while (NextBin(fl, sl) && FindSuitableBin(arena, fl, sl))
+            offset = std::min(offset, arena.bins[fl][sl]);
+        return offset != BLOCK_NIL;
+    }
+    
+    __inline bool FindFit(Arena& arena, size_t size, size_t& offset, PlacementNextFit)
+    {
+        if (arena.rover != BLOCK_NIL && (HeaderAt(arena.rover)->span & BLOCK_SPAN_MASK) >= size) {
+            offset = arena.rover;
+            return true;
+        }
+        return FindFit(arena, size, offset, PlacementGoodFit());
+    }
+    
+    // The smallest block of a bin list that holds size bytes, BLOCK_NIL if none does
+    size_t SmallestFit(size_t head, size_t size)
+    {
+        size_t best = BLOCK_NIL, best_size = SIZE_MAX;
+        for (size_t at = head; at != BLOCK_NIL && best_size != size; at = LinksAt(at)->next) {
+            size_t span = HeaderAt(at)->span & BLOCK_SPAN_MASK;
+            if (span >= size && span < best_size) {
+                best = at;
+                best_size = span;
+            }
+        }
+        return best;
+    }
+    
+    // Step to the bin after (fl, sl), false past the last one
+    __inline static bool NextBin(int& fl, int& sl)
+    {
+        if (++sl == TLSF_SL_COUNT) {
+            sl = 0;
+            fl++;
+        }
+        return fl < TLSF_FL_COUNT;
+    }
+    
+    // Allocate memory from the pool, the calling thread's arena first, then the others
+    void *_Nullable Malloc(size_t requestedSize, ZeroRange *_Nullable clean = NULL)
+    {
+        size_t home = HomeArena();
+        for (size_t i = 0; i < m_ArenaCount; i++) {
+            void *ptr = ArenaMalloc(m_Arenas[(home + i) % m_ArenaCount], requestedSize, clean);
+            if (ptr) {
+                StatAlloc(STAT_BLOCK, requestedSize);
+                return ptr;
+            }
+        }
+        return NULL;
+    }
+    
+    // Allocate memory from one arena, clean receives the range of the block known to be zero
+    void *_Nullable ArenaMalloc(Arena& arena, size_t requestedSize, ZeroRange *_Nullable clean = NULL)
+    {
         // Add space for the header and ensure alignment
-        size_t totalSize = requestedSize + sizeof(BlockHeader);
-        totalSize = ALIGN_UP(totalSize, MEMORY_ALIGNMENT);
+        size_t totalSize = BLOCK_SPAN(requestedSize);
         
-        if (m_FreeSize < totalSize) {
-            m_Internal.store(false, std::memory_order_relaxed);
-            m_Lock.unlock();
+        if (arena.free_size < totalSize && !arena.remote_head.load(std::memory_order_relaxed))
             return NULL;
-        }
+        
+        LockArena(arena);
         
         // Find the best fit block
         size_t offset, blockSize;
-        if (!FindBestFit(totalSize, offset, blockSize)) {
-            m_Internal.store(false, std::memory_order_relaxed);
-            m_Lock.unlock();
+        if (!FindFit(arena, totalSize, offset, blockSize)) {
+            arena.lock.unlock();
             return NULL;
         }
         
         // If the remainder is worth keeping, split the block
-        if (blockSize - totalSize >= MEMORY_ALIGNMENT * 2) {
-            // Split the block and add the remainder back to the free list
-            AddFreeBlock(offset + totalSize, blockSize - totalSize);
-            blockSize = totalSize;
+        size_t zero = LinksAt(offset)->zero;
+        size_t end = offset + blockSize;
+        blockSize = SplitBlock(arena, offset, blockSize, totalSize, zero);
+        if (clean) {
+            clean->begin = zero == BLOCK_NIL ? end : zero;
+            clean->end = std::min(end - sizeof(size_t), offset + blockSize);
         }
         
         // Set up the block header
-        BlockHeader* header = (BlockHeader*)&m_Data[offset];
-        header->size = requestedSize;
-        header->offset = offset;
-        header->token = TOKEN_ID;
+        SetBlockUsed(offset, blockSize, requestedSize);
         
-        m_FreeSize -= blockSize;
-        m_AllocCount++;
+        TakeFree(arena, blockSize);
+        arena.alloc_count++;
         
-        m_Internal.store(false, std::memory_order_relaxed);
-        m_Lock.unlock();
+        arena.lock.unlock();
         
         // Return pointer to the usable memory (after the header)
         return &m_Data[offset + sizeof(BlockHeader)];
     }
     
-    // Free memory back to the pool
+    // Allocate up to count blocks from one arena under a single lock, each free region found
+    // is cut into as many consecutive blocks as it holds. Returns the number of blocks taken.
+    size_t ArenaMallocBatch(Arena& arena, size_t requestedSize, size_t count, void *_Nullable *_Nonnull out)
+    {
+        size_t totalSize = BLOCK_SPAN(requestedSize);
+        
+        if (arena.free_size < totalSize && !arena.remote_head.load(std::memory_order_relaxed))
+            return 0;
+        
+        LockArena(arena);
+        
+        size_t taken = 0;
+        while (taken < count) {
+            // a region for the whole rest of the batch if there is one, else whatever fits a block
+            size_t offset, blockSize;
+            if (!FindFit(arena, totalSize * (count - taken), offset, blockSize) &&
+                !FindFit(arena, totalSize, offset, blockSize))
+                break;
+            
+            size_t zero = LinksAt(offset)->zero;
+            size_t n = std::min(count - taken, blockSize / totalSize);
+            for (size_t k = 0; k < n; k++) {
+                size_t span = totalSize;
+                
+                // the last block gets the remainder of the region if it is too small to split off
+                if (k == n - 1)
+                    span = SplitBlock(arena, offset, blockSize, totalSize, zero);
+                
+                SetBlockUsed(offset, span, requestedSize);
+                TakeFree(arena, span);
+                out[taken++] = &m_Data[offset + sizeof(BlockHeader)];
+                
+                offset += span;
+                blockSize -= span;
+            }
+        }
+        arena.alloc_count += taken;
+        
+        arena.lock.unlock();
+        StatAlloc(STAT_BLOCK, requestedSize * taken, taken);
+        return taken;
+    }
+    
+    // Allocate memory from the pool with the user pointer aligned to alignment
+    void *_Nullable MallocAligned(size_t requestedSize, size_t alignment)
+    {
+        size_t totalSize = BLOCK_SPAN(requestedSize);
+        
+        // the user pointer sits sizeof(BlockHeader) past the block and alignment is of the
+        // real address, so skew the offset by the header and by m_Data's own misalignment
+        size_t skew = sizeof(BlockHeader) + ((uintptr_t)m_Data & (alignment - 1));
+        
+        size_t home = HomeArena();
+        for (size_t i = 0; i < m_ArenaCount; i++) {
+            Arena& arena = m_Arenas[(home + i) % m_ArenaCount];
+            if (arena.free_size < totalSize && !arena.remote_head.load(std::memory_order_relaxed))
+                continue;
+            
+            LockArena(arena);
+            size_t offset;
+            bool carved = CarveAligned(arena, totalSize, alignment, skew, offset);
+            if (carved)
+                HeaderAt(offset)->size = requestedSize;
+            arena.lock.unlock();
+            
+            if (carved) {
+                StatAlloc(STAT_BLOCK, requestedSize);
+                return &m_Data[offset + sizeof(BlockHeader)];
+            }
+        }
+        return NULL;
+    }
+    
+    // Free memory back to the arena it came from
     void Free(void *_Nullable ptr)
     {
         if (!ptr)
             return;
-            
-        m_Lock.lock();
-        m_Internal.store(true, std::memory_order_relaxed);
-
+        
         // Get the block header
         BlockHeader* header = (BlockHeader*)((char*)ptr - sizeof(BlockHeader));
+        Arena& arena = ArenaOf((int8_t*)header - m_Data);
+        
         if (header->token != TOKEN_ID) {
             fprintf(stderr, "WARNING: Trying to free non-native pointer, incorrect tokenID\n");
-            m_Internal.store(false, std::memory_order_relaxed);
-            m_Lock.unlock();
+            return;
+        }
+        // the block is dead from here on, a second free of it fails the check above
+        header->token = 0;
+        StatFree(STAT_BLOCK, header->size);
+        
+        // Another thread's arena or a busy one: queue it and don't wait. A real-time thread always
+        // queues, and leaves the draining to the arena's next allocation
+        if (RealtimeThread()) {
+            PushRemoteFree(arena, ptr, false);
+            return;
+        }
+        if (!TryLockForFree(arena)) {
+            PushRemoteFree(arena, ptr);
             return;
         }
         
-        size_t offset = header->offset;
-        size_t size = ALIGN_UP(header->size + sizeof(BlockHeader), MEMORY_ALIGNMENT);
+        FreeBlock(arena, header->offset);
+        if (arena.remote_head.load(std::memory_order_relaxed))
+            DrainRemoteFrees(arena);
+        
+        arena.lock.unlock();
+    }
+    
+    // Put a used block back on the free lists, must be called with the arena's lock held
+    void FreeBlock(Arena& arena, size_t offset)
+    {
+        size_t size = HeaderAt(offset)->span & BLOCK_SPAN_MASK;
         
         // Add the block back to the free list
-        AddFreeBlock(offset, size);
+        AddFreeBlock(arena, offset, size);
+        
+        arena.free_size += size;
+        arena.free_count++;
+    }
+    
+    // Free sorted pointers of one arena, must be called with its lock held.
+    // Blocks that sit back to back are merged first and coalesced with their neighbours once.
+    void FreeBatch(Arena& arena, void *_Nullable *_Nonnull ptrs, size_t count)
+    {
+        size_t runOffset = 0, runSize = 0;
+        size_t blocks = 0, bytes = 0;
         
-        m_FreeSize += size;
-        m_FreeCount++;
+        for (size_t i = 0; i < count; i++) {
+            size_t offset = (int8_t*)ptrs[i] - m_Data;
+            if (m_PageMap[offset >> SLAB_SHIFT] == PAGE_SLAB) {
+                size_t sc = SlabAt(ALIGN_DOWN(offset, SLAB_SIZE))->sc;
+                StatFree(sc, SlabSlotSize(sc));
+                SlabFreeSlot(arena, offset);
+                continue;
+            }
+            
+            BlockHeader* header = (BlockHeader*)((char*)ptrs[i] - sizeof(BlockHeader));
+            if (!IsValidPointer(ptrs[i]) || header->token != TOKEN_ID) {
+                DEBUG_PRINTF(stderr, "WARNING: FreedomPool::free_batch() invalid or double free of %p\n", ptrs[i]);
+                continue;
+            }
+            header->token = 0;
+            arena.free_count++;
+            blocks++;
+            bytes += header->size;
+            
+            size_t span = header->span & BLOCK_SPAN_MASK;
+            if (runSize && runOffset + runSize == header->offset) {
+                runSize += span;
+                continue;
+            }
+            if (runSize) {
+                AddFreeBlock(arena, runOffset, runSize);
+                arena.free_size += runSize;
+            }
+            runOffset = header->offset;
+            runSize = span;
+        }
         
-        m_Internal.store(false, std::memory_order_relaxed);
-        m_Lock.unlock();
+        if (runSize) {
+            AddFreeBlock(arena, runOffset, runSize);
+            arena.free_size += runSize;
+        }
+        StatFree(STAT_BLOCK, bytes, blocks);
     }
     
 private:
 #ifdef FREEDOM_STACK_ALLOC
-    int8_t m_Data[poolsize];
+    alignas(poolsize >= POOL_ALIGNMENT ? POOL_ALIGNMENT : SLAB_SIZE) int8_t m_Data[poolsize];
 #else
     int8_t* m_Data;
 #endif
 
-    size_t m_MaxSize;                           // Total pool size
-    size_t m_FreeSize;                          // Available free space
+    size_t m_Reserved;                          // Address space the pool may grow into
+    uint8_t *_Nullable m_PageMap;               // PAGE_ kind of each SLAB_SIZE page
     
-    // Fast size-class based allocation system
-    std::vector<std::pair<size_t, size_t>> m_SizeClasses[SIZE_CLASS_COUNT];
+    Arena m_Arenas[MAX_ARENAS];                 // independent slices of the pool
+    size_t m_ArenaCount;                        // arenas in use, 0 until the pool is set up
+    size_t m_ArenaSpan;                         // size of each arena's slice
+    size_t m_NumaNodes;                         // NUMA nodes seen at startup
+    std::atomic<size_t> m_NextArena;            // round-robin arena assignment
     
-    // Address-ordered map for block coalescing
-    std::map<size_t, size_t> m_FreeBlocksByOffset;
+    pthread_key_t m_CacheKey;                   // Flushes thread caches on thread exit
+    uint64_t m_Generation;                      // NextGeneration(), matched by the caches bound to this pool
     
-    size_t m_AllocCount;                        // Number of allocations
-    size_t m_FreeCount;                         // Number of frees
+    HugeEntry *_Nullable m_HugeTable;           // side table of the directly mapped allocations
+    size_t m_HugeCapacity;                      // slots in m_HugeTable, a power of two
+    size_t m_HugeCount;                         // live huge allocations
+    size_t m_HugeBytes;                         // bytes mapped for them
+    size_t m_HugePeak;                          // high-water mark of m_HugeBytes
+    size_t m_HugeThreshold;                     // requests this large are mapped directly
+    bool m_FreshZero;                           // memory the pool grows into reads as zero
+    size_t m_PageSize;                          // commit and purge granularity, HUGE_PAGE_SIZE with huge pages
+    size_t m_HugeTlbSize;                       // bytes at the start of the reserve mapped from hugetlbfs
+    AtomicLock m_HugeLock;                      // guards the side table
+    std::atomic<RemoteFree*> m_DeferredFrees;   // frees outside the pool queued by real-time threads
     
-    AtomicLock m_Lock;                          // Thread synchronization
-    std::atomic<bool> m_Internal;               // Flag for internal operations
+#ifndef DISABLE_STATS
+    StatShard m_Stats[STATS_SHARDS];            // per-thread allocation counters
+#endif
+    pthread_t m_DumpThread;                     // periodic statistics dump
+    AtomicSema m_DumpSema;                      // signalled to stop it
+    uint64_t m_DumpInterval;                    // dump period in ns
+    bool m_DumpJson;                            // dump as JSON lines
+    bool m_DumpRunning;
+    
+    pthread_t m_PurgeThread;                    // decay purger
+    AtomicSema m_PurgeSema;                     // signalled to stop it
+    uint64_t m_PurgeInterval;                   // time between purge ticks in ns
+    std::atomic<uint64_t> m_PurgeTick;          // purge ticks so far, free blocks are stamped with it
+    bool m_PurgeRunning;
 };
 
 #if !defined(DISABLE_NEWDELETE_OVERRIDE)
@@ -576,13 +3087,29 @@ void *_Nullable operator new(std::size_t n);
 void operator delete(void *_Nullable p) throw();
 void *_Nullable operator new[](std::size_t n);
 void operator delete[](void *_Nullable p) throw();
+void operator delete(void *_Nullable p, std::size_t n) throw();
+void operator delete[](void *_Nullable p, std::size_t n) throw();
 
-extern FreedomPool<DEFAULT_GROW> bigpool;
+#ifdef __cpp_aligned_new
+void *_Nullable operator new(std::size_t n, std::align_val_t al);
+void operator delete(void *_Nullable p, std::align_val_t al) throw();
+void *_Nullable operator new[](std::size_t n, std::align_val_t al);
+void operator delete[](void *_Nullable p, std::align_val_t al) throw();
+void operator delete(void *_Nullable p, std::size_t n, std::align_val_t al) throw();
+void operator delete[](void *_Nullable p, std::size_t n, std::align_val_t al) throw();
+#endif
 
 size_t malloc_size(const void *_Nullable ptr);
 size_t malloc_usable_size(void *_Nullable ptr);
 
 #endif // DISABLE_NEWDELETE_OVERRIDE
 
+// The process wide pool behind the overrides (freedom_pool.cpp)
+#ifdef FREEDOM_PRELOAD
+extern FreedomPool<DEFAULT_GROW>& bigpool;      // built by the first allocation and never destroyed
+#else
+extern FreedomPool<DEFAULT_GROW> bigpool;
+#endif
+
 #endif // __cplusplus
 
@@ -0,0 +1,950 @@
+//  freedom_test.cpp - behaviour tests for FreedomPool
+//
+//  Each test drives a pool through its public interface and CHECKs the outcome, failures are
+//  printed with their line and make the run exit non-zero. Built once per memory model by
+//  tests/Makefile (make check), the pool under test is bigpool unless a test makes its own.
+
+#include "freedom_pool.h"
+#include "freedom_object_pool.h"
+#include "freedom_allocator.h"
+#include "freedom_arena.h"
+
+#include <algorithm>
+#include <thread>
+#include <vector>
+#include <string>
+#ifdef __linux__
+#include <sys/prctl.h>
+#include <sys/wait.h>
+#include <linux/seccomp.h>
+#endif
+
+static int failures = 0;
+
+struct TestObject {
+    double  x;
+    int     id;
+    TestObject(int i) : x(i * 0.5), id(i) {}
+};
+
+struct alignas(64) WideObject {
+    char    bytes[80];
+};
+
+#define CHECK(cond) \
+    do { \
+        if (!(cond)) { \
+            fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+            failures++; \
+        } \
+    } while (0)
+
+// Threads contending on an AtomicLock never lose an increment of what it guards
+static void test_atomic_lock()
+{
+    static AtomicLock lock;
+    static size_t counter = 0;
+    static const size_t threads = 8, rounds = 100000;
+    std::vector<std::thread> workers;
+    for (size_t t = 0; t < threads; t++) {
+        workers.emplace_back([]() {
+            for (size_t i = 0; i < rounds; i++) {
+                lock.lock();
+                counter++;
+                lock.unlock();
+            }
+        });
+    }
+    for (std::thread& worker : workers)
+        worker.join();
+    CHECK(counter == threads * rounds);
+    CHECK(!lock.islocked());
+    lock.lock();
+    CHECK(lock.islocked());
+    lock.unlock();
+}
+
+// AtomicSema hands each signal to exactly one waiter, producers ahead of consumers or behind them.
+// A timed wait gives up after its timeout when nothing is signalled
+static void test_atomic_sema()
+{
+    static AtomicSema items;
+    static std::atomic<size_t> produced(0), consumed(0);
+    static const size_t producers = 4, consumers = 4, count = 50000;
+    std::vector<std::thread> workers;
+    for (size_t t = 0; t < producers; t++) {
+        workers.emplace_back([]() {
+            for (size_t i = 0; i < count; i++) {
+                produced.fetch_add(1, std::memory_order_relaxed);
+                items.signal();
+            }
+        });
+    }
+    for (size_t t = 0; t < consumers; t++) {
+        workers.emplace_back([]() {
+            for (size_t i = 0; i < count; i++) {
+                CHECK(items.wait() == 0);
+                consumed.fetch_add(1, std::memory_order_relaxed);
+            }
+        });
+    }
+    for (std::thread& worker : workers)
+        worker.join();
+    CHECK(produced == producers * count && consumed == consumers * count);
+    CHECK(items.trywait() != 0);
+    
+    auto start = std::chrono::steady_clock::now();
+    CHECK(items.wait(20 * 1000000ULL) != 0);
+    CHECK(std::chrono::steady_clock::now() - start >= std::chrono::milliseconds(20));
+    items.signal();
+    CHECK(items.wait(20 * 1000000ULL) == 0);
+    
+    // a signal arriving during a timed wait ends it
+    std::thread late([]() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        items.signal();
+    });
+    CHECK(items.wait(5000 * 1000000ULL) == 0);
+    late.join();
+}
+
+// memalign rejects alignments that aren't a power of two, small ones and 0 included
+static void test_memalign()
+{
+    static const size_t bad[] = { 0, 3, 12, 24, 48, 100 };
+    for (size_t alignment : bad) {
+        errno = 0;
+        CHECK(bigpool.memalign(alignment, 64) == NULL);
+        CHECK(errno == EINVAL);
+    }
+    for (size_t alignment = 1; alignment <= 4096; alignment <<= 1) {
+        void *p = bigpool.memalign(alignment, 100);
+        CHECK(p && ((uintptr_t)p & (alignment - 1)) == 0);
+        bigpool.free(p);
+    }
+}
+
+// A thread's small frees go to its cache and come straight back to its next allocations of the
+// class. What the cache holds when the thread exits goes back to the slabs for other threads
+static void test_thread_cache()
+{
+    static FreedomPool<64 * MBYTE> pool;
+    static void *first;
+    std::thread([]() {
+        first = pool.malloc(48);
+        CHECK(first && pool.IsPoolPointer(first));
+        pool.free(first);
+        CHECK(pool.malloc(40) == first);
+        pool.free(first);
+    }).join();
+    
+#ifdef FREEDOM_STACK_ALLOC
+    // the static pool has a single arena, so the next thread refills from the same slab
+    std::thread([]() {
+        void *ptrs[THREAD_CACHE_BATCH];
+        bool found = false;
+        for (size_t i = 0; i < THREAD_CACHE_BATCH; i++)
+            found |= (ptrs[i] = pool.malloc(48)) == first;
+        CHECK(found);
+        for (size_t i = 0; i < THREAD_CACHE_BATCH; i++)
+            pool.free(ptrs[i]);
+    }).join();
+#endif
+}
+
+// A freed block joins its free neighbours on both sides through the boundary tags, without
+// reading any list, until the arena's free space is a single block again
+static void test_coalesce()
+{
+    static FreedomPool<64 * MBYTE> pool;
+    size_t blocks = pool.GetStats().free_blocks;
+    void *a = pool.malloc(10000), *b = pool.malloc(20000), *c = pool.malloc(30000), *d = pool.malloc(40000);
+    CHECK(a && b && c && d);
+    
+    pool.free(a);
+    pool.free(c);
+    CHECK(pool.GetStats().free_blocks == blocks + 2);
+    pool.free(b);       // joins a before it and c after it
+    CHECK(pool.GetStats().free_blocks == blocks + 1);
+    
+    void *e = pool.malloc(50000);
+    CHECK(e == a);      // the joined block starts where a did, and is the smallest that fits
+    pool.free(e);
+    pool.free(d);
+    FreedomStats stats = pool.GetStats();
+    CHECK(stats.free_blocks == blocks && pool.GetUsedSize() == 0);
+}
+
+// A pool a thread allocated from and destroyed no longer owns its cache, the thread exits cleanly
+// and its next pool binds the cache afresh
+static void test_pool_lifetime()
+{
+    std::thread([]() {
+        for (int i = 0; i < 3; i++) {
+            FreedomPool<64 * MBYTE> *pool = new FreedomPool<64 * MBYTE>;
+            void *p = pool->malloc(32);
+            CHECK(p && pool->IsPoolPointer(p));
+            pool->free(p);
+            CHECK(pool->malloc(32) == p);
+            pool->free(p);
+            delete pool;
+        }
+    }).join();
+}
+
+// A thread's cache still bound to a destroyed pool is dropped by a pool later built at the same address,
+// its slots are never handed out again next to the new pool's own
+static void test_pool_reuse()
+{
+    typedef FreedomPool<64 * MBYTE> Pool;
+    alignas(Pool) static char storage[sizeof(Pool)];
+    static std::atomic<int> step(0);
+    static void *theirs[THREAD_CACHE_BATCH], *mine[2 * THREAD_CACHE_BATCH];
+    static Pool *pool = new (storage) Pool;
+    std::thread worker([]() {
+        pool->free(pool->malloc(48));       // leaves a batch of the class in the cache
+        step = 1;
+        while (step != 2)
+            sched_yield();
+        for (size_t i = 0; i < THREAD_CACHE_BATCH; i++)
+            CHECK((theirs[i] = pool->malloc(48)) != NULL);
+    });
+    while (step != 1)
+        sched_yield();
+    pool->~Pool();
+    pool = new (storage) Pool;
+    for (size_t i = 0; i < 2 * THREAD_CACHE_BATCH; i++)
+        CHECK((mine[i] = pool->malloc(48)) != NULL);
+    step = 2;
+    worker.join();
+    
+    for (size_t i = 0; i < THREAD_CACHE_BATCH; i++) {
+        CHECK(pool->IsPoolPointer(theirs[i]));
+        CHECK(std::find(mine, mine + 2 * THREAD_CACHE_BATCH, theirs[i]) == mine + 2 * THREAD_CACHE_BATCH);
+        pool->free(theirs[i]);
+    }
+    for (size_t i = 0; i < 2 * THREAD_CACHE_BATCH; i++)
+        pool->free(mine[i]);
+    pool->~Pool();
+}
+
+#ifndef DISABLE_THREAD_CACHE
+// Blocks a real-time thread frees are only queued on their arena's remote free stack. The arena's
+// next allocation drains them back into its free lists
+static void test_remote_free()
+{
+    static FreedomPool<64 * MBYTE> pool;
+    static void *ptrs[100];
+    size_t used = pool.GetUsedSize();
+    for (size_t i = 0; i < 100; i++)
+        CHECK((ptrs[i] = pool.malloc(5000 + i * 16)) != NULL);
+    size_t blocks = pool.GetUsedSize() - used;
+    
+    static size_t queued;
+    std::thread([]() {
+        CHECK(pool.RegisterRealtimeThread(1));
+        queued = pool.GetUsedSize();
+        for (size_t i = 0; i < 100; i++)
+            pool.free(ptrs[i]);
+        CHECK(pool.GetUsedSize() == queued);
+        pool.UnregisterRealtimeThread();
+    }).join();
+    
+    void *p = pool.malloc(5000);
+    CHECK(p == ptrs[0]);
+    pool.free(p);
+    CHECK(pool.GetUsedSize() == queued - blocks);
+}
+#endif
+
+// malloc_batch hands out count separate aligned blocks of the size, slab slots and blocks alike.
+// free_batch takes them back in any order, runs of neighbours rejoin as a single free block
+static void test_batch()
+{
+    static FreedomPool<64 * MBYTE> pool;
+    static void *ptrs[500];
+    static const size_t sizes[] = { 3000, 70000, 24, 2000 };
+    size_t blocks = pool.GetStats().free_blocks;
+    size_t in_use = pool.GetStats().in_use;
+    for (size_t size : sizes) {
+        CHECK(pool.malloc_batch(size, 500, ptrs) == 500);
+        for (size_t i = 0; i < 500; i++) {
+            CHECK(ptrs[i] && ((uintptr_t)ptrs[i] & (MEMORY_ALIGNMENT - 1)) == 0);
+            CHECK(pool.malloc_usable_size(ptrs[i]) >= size);
+        }
+        std::sort(ptrs, ptrs + 500);
+        for (size_t i = 1; i < 500; i++)
+            CHECK((char*)ptrs[i - 1] + size <= (char*)ptrs[i]);
+        
+        std::reverse(ptrs, ptrs + 500);
+        pool.free_batch(ptrs, 500);
+        if (size > SLAB_MAX_SIZE)
+            CHECK(pool.GetStats().free_blocks == blocks);
+    }
+    CHECK(pool.GetStats().in_use == in_use);
+}
+
+#ifndef FREEDOM_STACK_ALLOC
+// A batch larger than the committed pages grows the pool, slab slots and blocks alike
+static void test_batch_grow()
+{
+    static const size_t sizes[] = { 24, 3000 }, counts[] = { 3000000, 30000 };
+    for (size_t k = 0; k < 2; k++) {
+        FreedomPool<256 * MBYTE>& pool = *new FreedomPool<256 * MBYTE>;
+        size_t committed = pool.GetMaxSize();
+        std::vector<void*> ptrs(counts[k]);
+        CHECK(sizes[k] * counts[k] > committed);
+        CHECK(pool.malloc_batch(sizes[k], counts[k], ptrs.data()) == counts[k]);
+        CHECK(pool.GetMaxSize() > committed);
+        pool.free_batch(ptrs.data(), counts[k]);
+        CHECK(pool.GetStats().in_use == 0);
+        delete &pool;
+    }
+}
+#endif
+
+// free_sized puts a slab slot back by the class of the size it is given, straight into the thread's
+// cache, blocks and huge mappings by their header or the side table. After realloc the size is the new one
+static void test_free_sized()
+{
+    static const size_t sizes[] = { 1, 16, 100, SLAB_MAX_SIZE, 5000, 100000, 100 * MBYTE };
+    size_t in_use = bigpool.GetStats().in_use;
+    size_t mapped = bigpool.GetHugeSize();
+    for (size_t size : sizes) {
+        char *p = (char*)bigpool.malloc(size);
+        CHECK(p);
+        memset(p, 0x11, size);
+        bigpool.free_sized(p, size);
+        if (size <= SLAB_MAX_SIZE) {
+            CHECK(bigpool.malloc(size) == p);
+            bigpool.free_sized(p, size);
+        }
+    }
+    
+    void *p = bigpool.realloc(bigpool.malloc(100), 1000);
+    CHECK(p);
+    bigpool.free_sized(p, 1000);
+    CHECK(bigpool.GetStats().in_use == in_use);
+    CHECK(bigpool.GetHugeSize() == mapped);
+}
+
+// FreedomObjectPool hands out slots aligned for T from chunks of ChunkCount, and reuses freed slots
+// before it takes another chunk. With the thread cache, slots a thread holds go back when it exits
+static void test_object_pool()
+{
+    static FreedomObjectPool<TestObject, 16, false> objects;
+    static TestObject *live[40];
+    for (int round = 0; round < 2; round++) {
+        for (int i = 0; i < 40; i++) {
+            live[i] = objects.construct(i);
+            CHECK(live[i] && live[i]->id == i && live[i]->x == i * 0.5 && objects.Owns(live[i]));
+        }
+        CHECK(objects.GetChunkCount() == 3 && objects.GetCapacity() == 48);
+        for (int i = 0; i < 40; i++)
+            objects.destroy(live[i]);
+    }
+    int local = 0;
+    CHECK(!objects.Owns(&local));
+    
+    static FreedomObjectPool<WideObject> wide;
+    static size_t chunks;
+    std::thread([]() {
+        for (int i = 0; i < 40; i++) {
+            WideObject *w = wide.construct();
+            CHECK(w && ((uintptr_t)w & 63) == 0 && wide.Owns(w));
+            wide.destroy(w);
+        }
+        chunks = wide.GetChunkCount();
+    }).join();
+    
+    // the exited thread's cache is back on the pool's list, so this takes no new chunk
+    std::thread([]() {
+        static WideObject *held[OBJECT_POOL_CHUNK];
+        size_t count = std::min(wide.GetCapacity(), (size_t)OBJECT_POOL_CHUNK);
+        for (size_t i = 0; i < count; i++)
+            CHECK((held[i] = wide.construct()) != NULL);
+        CHECK(wide.GetChunkCount() == chunks);
+        for (size_t i = 0; i < count; i++)
+            wide.destroy(held[i]);
+    }).join();
+}
+
+// Same for the object pool: a cache left over from a destroyed pool never hands out slots of its freed chunks
+static void test_object_pool_reuse()
+{
+    typedef FreedomObjectPool<TestObject> Objects;
+    alignas(Objects) static char storage[sizeof(Objects)];
+    static std::atomic<int> step(0);
+    static TestObject *theirs[Objects::CacheBatch], *mine[2 * Objects::CacheBatch];
+    static Objects *objects = new (storage) Objects;
+    std::thread worker([]() {
+        objects->destroy(objects->construct(0));
+        step = 1;
+        while (step != 2)
+            sched_yield();
+        for (size_t i = 0; i < Objects::CacheBatch; i++)
+            CHECK((theirs[i] = objects->construct(1)) != NULL);
+    });
+    while (step != 1)
+        sched_yield();
+    objects->~Objects();
+    objects = new (storage) Objects;
+    for (size_t i = 0; i < 2 * Objects::CacheBatch; i++)
+        CHECK((mine[i] = objects->construct(2)) != NULL);
+    step = 2;
+    worker.join();
+    
+    for (size_t i = 0; i < Objects::CacheBatch; i++) {
+        CHECK(objects->Owns(theirs[i]) && theirs[i]->id == 1);
+        CHECK(std::find(mine, mine + 2 * Objects::CacheBatch, theirs[i]) == mine + 2 * Objects::CacheBatch);
+    }
+    for (size_t i = 0; i < 2 * Objects::CacheBatch; i++)
+        CHECK(mine[i]->id == 2);
+    objects->~Objects();
+}
+
+// FreedomAllocator and FreedomMemoryResource put containers on a pool of their own, over-aligned
+// types included, and everything goes back to it with the containers
+static void test_allocator()
+{
+    typedef FreedomPool<64 * MBYTE> Pool;
+    typedef FreedomAllocator<int, Pool> IntAllocator;
+    typedef FreedomAllocator<WideObject, Pool> WideAllocator;
+    static Pool pool;
+    size_t in_use = pool.GetStats().in_use;
+    {
+        std::vector<int, IntAllocator> v((IntAllocator(pool)));
+        for (int i = 0; i < 100000; i++)
+            v.push_back(i);
+        CHECK(pool.IsPoolPointer(v.data()) && v[99999] == 99999);
+        
+        std::vector<WideObject, WideAllocator> w(10, WideObject(), WideAllocator(pool));
+        CHECK(pool.IsPoolPointer(w.data()) && ((uintptr_t)w.data() & 63) == 0);
+        CHECK(v.get_allocator() == w.get_allocator());
+    }
+    CHECK(pool.GetStats().in_use == in_use);
+    
+#ifdef __cpp_lib_memory_resource
+    {
+        FreedomMemoryResource<64 * MBYTE> resource(pool), other(pool);
+        std::pmr::vector<std::pmr::string> strings(&resource);
+        for (int i = 0; i < 1000; i++)
+            strings.emplace_back(100, (char)('a' + i % 26));
+        CHECK(pool.IsPoolPointer(strings.data()) && pool.IsPoolPointer(strings[999].data()));
+        CHECK(strings[999][99] == 'a' + 999 % 26);
+        
+        void *p = resource.allocate(100, 256);
+        CHECK(pool.IsPoolPointer(p) && ((uintptr_t)p & 255) == 0);
+        other.deallocate(p, 100, 256);
+        CHECK(resource.is_equal(other));
+    }
+    CHECK(pool.GetStats().in_use == in_use);
+#endif
+}
+
+// FreedomArena bumps through its chunks, rewind() and a FreedomArenaScope give back what came after
+// their mark, chunks are kept for reuse except oversized ones, and Release() returns them all
+static void test_arena()
+{
+    FreedomArena<> arena(bigpool, 4096);
+    size_t in_use = bigpool.GetStats().in_use;
+    char *a = (char*)arena.allocate(100);
+    char *b = (char*)arena.allocate(100);
+    CHECK(a && b == a + ALIGN_UP(100, MEMORY_ALIGNMENT));
+    CHECK(((uintptr_t)arena.allocate(10, 256) & 255) == 0);
+    size_t reserved = arena.GetReserved();
+    CHECK(reserved == 4096);
+    
+    FreedomArena<>::Mark mark = arena.mark();
+    char *c = (char*)arena.allocate(100);
+    for (int i = 0; i < 100; i++)
+        CHECK(arena.allocate(1000) != NULL);        // spills into new chunks
+    size_t kept = arena.GetReserved();
+    CHECK(kept > reserved);
+    CHECK(arena.allocate(100000) != NULL);          // an oversized chunk of its own
+    CHECK(arena.GetReserved() > kept + 100000);
+    arena.rewind(mark);
+    CHECK(arena.allocate(100) == c);
+    CHECK(arena.GetReserved() == kept);             // the oversized chunk went back to the pool
+    
+    {
+        FreedomArenaScope<> scope(arena);
+        double *d = arena.allocate_array<double>(1000);
+        CHECK(d && ((uintptr_t)d & (alignof(double) - 1)) == 0);
+        TestObject *o = arena.construct<TestObject>(7);
+        CHECK(o && o->id == 7);
+    }
+    arena.reset();
+    for (int i = 0; i < 100; i++)
+        CHECK(arena.allocate(1000) != NULL);
+    CHECK(arena.GetReserved() == kept);            // the spare chunks came back into use
+    
+    arena.Release();
+    CHECK(arena.GetReserved() == 0);
+    CHECK(bigpool.GetStats().in_use == in_use);
+}
+
+// Every placement policy runs a random mix of allocations and frees with the data intact,
+// and the pool's free space ends up as it started
+template <typename Placement>
+static void check_placement()
+{
+    FreedomPool<64 * MBYTE, Placement> &pool = *new FreedomPool<64 * MBYTE, Placement>;
+    static unsigned char *ptrs[500];
+    static size_t sizes[500];
+    size_t blocks = pool.GetStats().free_blocks;
+    uint32_t seed = 12345;
+    for (int round = 0; round < 5000; round++) {
+        seed = seed * 1103515245 + 12345;
+        size_t i = (seed >> 8) % 500;
+        if (ptrs[i]) {
+            CHECK(ptrs[i][0] == (unsigned char)i && ptrs[i][sizes[i] - 1] == (unsigned char)i);
+            pool.free(ptrs[i]);
+            ptrs[i] = NULL;
+        } else {
+            sizes[i] = 3000 + (seed >> 12) % 30000;
+            ptrs[i] = (unsigned char*)pool.malloc(sizes[i]);
+            CHECK(ptrs[i]);
+            if (ptrs[i])
+                memset(ptrs[i], (int)i, sizes[i]);
+        }
+    }
+    for (size_t i = 0; i < 500; i++) {
+        pool.free(ptrs[i]);
+        ptrs[i] = NULL;
+    }
+    CHECK(pool.GetStats().free_blocks == blocks && pool.GetUsedSize() == 0);
+    delete &pool;
+}
+
+// First fit takes the lowest hole that fits, best fit the smallest, next fit keeps cutting
+// the block the previous allocation was cut from
+static void test_placement()
+{
+    check_placement<PlacementGoodFit>();
+    check_placement<PlacementBoundedFit>();
+    check_placement<PlacementBestFit>();
+    check_placement<PlacementFirstFit>();
+    check_placement<PlacementNextFit>();
+    
+    FreedomPool<64 * MBYTE, PlacementFirstFit> &first = *new FreedomPool<64 * MBYTE, PlacementFirstFit>;
+    void *a = first.malloc(20000), *b = first.malloc(10000), *c = first.malloc(20000), *d = first.malloc(10000);
+    first.free(a);
+    first.free(c);
+    CHECK(first.malloc(5000) == a);
+    first.free(a);
+    first.free(b);
+    first.free(d);
+    delete &first;
+    
+    FreedomPool<64 * MBYTE, PlacementBestFit> &best = *new FreedomPool<64 * MBYTE, PlacementBestFit>;
+    a = best.malloc(20000), b = best.malloc(10000), c = best.malloc(10000), d = best.malloc(10000);
+    best.free(a);
+    best.free(c);
+    CHECK(best.malloc(9000) == c);
+    best.free(b);
+    best.free(c);
+    best.free(d);
+    delete &best;
+    
+    FreedomPool<64 * MBYTE, PlacementNextFit> &next = *new FreedomPool<64 * MBYTE, PlacementNextFit>;
+    a = next.malloc(5000);
+    for (int i = 0; i < 10; i++) {
+        b = next.malloc(5000);
+        CHECK((char*)b > (char*)a && (char*)b - (char*)a < 5000 + 128);
+        a = b;
+    }
+    delete &next;
+}
+
+// Every allocation is MEMORY_ALIGNMENT aligned and holds its size, whatever the tuning knobs were built with
+static void test_alignment()
+{
+    static void *ptrs[600];
+    size_t count = 0;
+    for (size_t size = 1; size <= 3 * SLAB_MAX_SIZE && count < 600; size += 13) {
+        void *p = ptrs[count++] = bigpool.malloc(size);
+        CHECK(p && ((uintptr_t)p & (MEMORY_ALIGNMENT - 1)) == 0);
+        CHECK(bigpool.malloc_usable_size(p) >= size);
+        memset(p, 0x33, size);
+    }
+    for (size_t i = 0; i < count; i++)
+        bigpool.free(ptrs[i]);
+}
+
+#ifndef DISABLE_STATS
+// GetStats counts allocations and frees per slab class, of blocks and of huge mappings, the bytes in
+// use and their peak, and DumpStats prints the same snapshot as a line of JSON
+static void test_stats()
+{
+    static FreedomPool<64 * MBYTE> pool;
+    FreedomStats before = pool.GetStats();
+    void *slot = pool.malloc(100), *block = pool.malloc(10000), *huge = pool.malloc(100 * MBYTE);
+    CHECK(slot && block && huge);
+    
+    FreedomStats stats = pool.GetStats();
+    size_t slots = 0;
+    for (size_t sc = 0; sc < SLAB_CLASS_COUNT; sc++)
+        slots += stats.allocs[sc] - before.allocs[sc];
+    CHECK(slots == 1);
+    CHECK(stats.allocs[STAT_BLOCK] - before.allocs[STAT_BLOCK] == 1);
+    CHECK(stats.allocs[STAT_HUGE] - before.allocs[STAT_HUGE] == 1);
+    CHECK(stats.in_use - before.in_use >= 100 + 10000 + 100 * MBYTE);
+    CHECK(stats.peak >= stats.in_use - stats.huge_size && stats.huge_size >= 100 * MBYTE);
+    CHECK(stats.lock_acquires > before.lock_acquires);
+    
+    pool.free(slot);
+    pool.free(block);
+    pool.free(huge);
+    stats = pool.GetStats();
+    CHECK(stats.frees[STAT_BLOCK] - before.frees[STAT_BLOCK] == 1);
+    CHECK(stats.frees[STAT_HUGE] - before.frees[STAT_HUGE] == 1);
+    CHECK(stats.in_use == before.in_use && stats.huge_size == before.huge_size);
+    
+    char line[4096] = "";
+    FILE *out = tmpfile();
+    CHECK(out);
+    if (out) {
+        pool.DumpStats(out, true);
+        rewind(out);
+        CHECK(fgets(line, sizeof(line), out) != NULL);
+        fclose(out);
+    }
+    CHECK(strncmp(line, "{\"in_use\":", 10) == 0 && strstr(line, "\"classes\":[") != NULL);
+}
+#endif
+
+static bool all_zero(const void *_Nullable p, size_t size)
+{
+    for (size_t i = 0; i < size; i++) {
+        if (((const unsigned char*)p)[i])
+            return false;
+    }
+    return true;
+}
+
+// calloc fails on an overflowing count * size, takes small requests from the slabs and clears whatever
+// isn't known to be zero: a dirtied and freed block it reuses reads zero, alone or joined with fresh memory
+static void test_calloc()
+{
+    static FreedomPool<64 * MBYTE> pool;
+    errno = 0;
+    CHECK(pool.calloc(SIZE_MAX / 2, 4) == NULL);
+    CHECK(errno == ENOMEM);
+    
+#ifndef DISABLE_STATS
+    FreedomStats before = pool.GetStats();
+#endif
+    void *small = pool.calloc(10, 10);
+    CHECK(small && all_zero(small, 100));
+#ifndef DISABLE_STATS
+    FreedomStats stats = pool.GetStats();
+    size_t slots = 0;
+    for (size_t sc = 0; sc < SLAB_CLASS_COUNT; sc++)
+        slots += stats.allocs[sc] - before.allocs[sc];
+    CHECK(slots == 1 && stats.allocs[STAT_BLOCK] == before.allocs[STAT_BLOCK]);
+#endif
+    memset(small, 0xAA, 100);
+    pool.free(small);
+    small = pool.calloc(100, 1);
+    CHECK(small && all_zero(small, 100));
+    pool.free(small);
+    
+    static const size_t size = 1 * MBYTE;
+    void *dirty = pool.malloc(size);
+    CHECK(dirty);
+    memset(dirty, 0xAA, size);
+    pool.free(dirty);
+    void *again = pool.calloc(1, size);
+    CHECK(again == dirty && all_zero(again, size));
+    memset(again, 0xAA, size);
+    pool.free(again);
+    
+    // the dirtied block joined the untouched rest of the arena, only its own part needs clearing
+    again = pool.calloc(2, size);
+    CHECK(again == dirty && all_zero(again, 2 * size));
+    pool.free(again);
+}
+
+// Fragmentation is measured per arena: an untouched pool of several arenas has none,
+// free blocks split by live ones do
+static void test_fragmentation()
+{
+    static FreedomPool<256 * MBYTE> pool;
+    FreedomStats stats = pool.GetStats();
+    CHECK(pool.GetArenaCount() > 1);
+    CHECK(stats.free_size > 0 && stats.fragmentation == 0.0);
+    
+    static void *ptrs[64];
+    for (size_t i = 0; i < 64; i++)
+        ptrs[i] = pool.malloc(100000);
+    for (size_t i = 0; i < 64; i += 2)
+        pool.free(ptrs[i]);
+    stats = pool.GetStats();
+    CHECK(stats.fragmentation > 0.0 && stats.fragmentation < 1.0);
+    
+    for (size_t i = 1; i < 64; i += 2)
+        pool.free(ptrs[i]);
+    CHECK(pool.GetStats().fragmentation == 0.0);
+}
+
+// try_expand grows toward max_size in place even when min_size is already covered
+static void test_try_expand()
+{
+    static FreedomPool<64 * MBYTE> pool;
+    char *a = (char*)pool.malloc(10000);
+    char *b = (char*)pool.malloc(10000);
+    CHECK(a && b);
+    memset(a, 0x5a, 10000);
+    pool.free(b);
+    
+    size_t size = pool.try_expand(a, 100, 50000);
+    CHECK(size >= 50000);
+    CHECK(pool.malloc_usable_size(a) == size);
+    CHECK(a[0] == 0x5a && a[9999] == 0x5a);
+    
+    // nothing past max_size, and a min_size out of reach leaves the block as it is
+    CHECK(pool.try_expand(a, 100, 50000) == size);
+    CHECK(pool.try_expand(a, 1024 * MBYTE, 0) == size);
+    pool.free(a);
+}
+
+#ifndef FREEDOM_STACK_ALLOC
+// Growth moves on to the other arenas' reserve once the thread's own slice is fully committed.
+// The blocks are never touched, they only cost address space
+static void test_grow_arenas()
+{
+    FreedomPool<64 * MBYTE>& pool = *new FreedomPool<64 * MBYTE>;
+    pool.SetHugeThreshold(SIZE_MAX);
+    CHECK(pool.GetArenaCount() > 1);
+    
+    static void *blocks[256];
+    size_t count = 0;
+    while (count < 256 && (blocks[count] = pool.malloc(1024 * MBYTE)) != NULL)
+        count++;
+    
+    // more than one slice holds, so more than the home arena grew
+    CHECK(count > DEFAULT_RESERVE / pool.GetArenaCount() / (1024 * MBYTE));
+    for (size_t i = 0; i < count; i++)
+        pool.free(blocks[i]);
+    pool.Trim();        // drains the frees queued on the other arenas
+    CHECK(pool.GetUsedSize() == 0);
+    delete &pool;       // gives the committed reserve back
+}
+#endif
+
+// A directly mapped block only ever grows in try_expand, a max_size below min_size is taken as min_size
+static void test_try_expand_huge()
+{
+    size_t length = 100 * MBYTE;
+    char *p = (char*)bigpool.malloc(length);
+    CHECK(p && bigpool.malloc_usable_size(p) == length);
+    memset(p, 1, length);
+    
+    size_t size = bigpool.try_expand(p, 200 * MBYTE, 0);
+    CHECK(size == length || size >= 200 * MBYTE);
+    CHECK(bigpool.malloc_usable_size(p) == size);
+    memset(p, 2, size);
+    
+    // already large enough, and an impossible max_size, leave it alone
+    CHECK(bigpool.try_expand(p, 1, 1) == size);
+    CHECK(bigpool.try_expand(p, 1, SIZE_MAX) == size);
+    CHECK(p[0] == 2 && p[size - 1] == 2);
+    
+    // realloc keeps the data whichever way it goes
+    p = (char*)bigpool.realloc(p, 300 * MBYTE);
+    CHECK(p && p[0] == 2 && p[size - 1] == 2);
+    p = (char*)bigpool.realloc(p, 80 * MBYTE);
+    CHECK(p && p[0] == 2 && p[80 * MBYTE - 1] == 2);
+    bigpool.free(p);
+    CHECK(bigpool.GetHugeSize() == 0);
+}
+
+#ifdef FREEDOM_STACK_ALLOC
+// A pool too small for aligned arena slices is one arena over all of it, and hands out only its own memory
+template <size_t poolsize> static void check_small_pool()
+{
+    static FreedomPool<poolsize> pool;
+    CHECK(pool.GetArenaCount() == 1);
+    CHECK(pool.GetMaxSize() > 0 && pool.GetMaxSize() <= ALIGN_UP(poolsize, SLAB_SIZE));
+#ifdef FREEDOM_HUGE_PAGES
+    // huge pages only for pools that hold one, and then the pool starts on one
+    if (poolsize < HUGE_PAGE_SIZE)
+        CHECK(pool.GetPageSize() == (size_t)getpagesize());
+    else if (pool.GetPageSize() == HUGE_PAGE_SIZE)
+        CHECK((uintptr_t)&pool % HUGE_PAGE_SIZE == 0);
+#endif
+    
+    void *blocks[4096];
+    size_t count = 0;
+    while (count < 4096 && (blocks[count] = pool.malloc(3000))) {
+        CHECK(pool.IsPoolPointer(blocks[count]) && pool.IsValidPointer(blocks[count]));
+#ifdef FREEDOM_STACK_ALLOC
+        CHECK((char*)blocks[count] >= (char*)&pool && (char*)blocks[count] + 3000 <= (char*)&pool + sizeof(pool));
+#endif
+        memset(blocks[count], 7, 3000);
+        count++;
+    }
+    CHECK(count > 0 && count < 4096);
+    for (size_t i = 0; i < count; i++)
+        pool.free(blocks[i]);
+    CHECK(pool.GetUsedSize() == 0);
+}
+
+static void test_small_pools()
+{
+    check_small_pool<32 * KBYTE>();
+    check_small_pool<100 * KBYTE>();
+    check_small_pool<1 * MBYTE>();
+    check_small_pool<2 * MBYTE>();
+    check_small_pool<3 * MBYTE>();
+}
+#endif
+
+// Trim counts each released page once, even while neighbours of the blocks it purges are being freed,
+// and calloc of purged memory reads zero
+static void test_trim()
+{
+    static FreedomPool<128 * MBYTE> pool;
+    const size_t size = 256 * KBYTE, count = 256;
+    static void *blocks[count];
+    
+    for (int round = 0; round < 8; round++) {
+        for (size_t i = 0; i < count; i++) {
+            blocks[i] = pool.malloc(size);
+            CHECK(blocks[i] != NULL);
+            if (blocks[i])
+                memset(blocks[i], 0xa5, size);
+        }
+        for (size_t i = 0; i < count; i += 2)
+            pool.free(blocks[i]);
+        
+        std::thread freeing([&] {
+            for (size_t i = 1; i < count; i += 2)
+                pool.free(blocks[i]);
+        });
+        size_t released = pool.Trim();
+        freeing.join();
+        CHECK(released <= pool.GetFreeSize());
+        pool.Trim();
+    }
+    
+    for (size_t i = 0; i < count; i++) {
+        unsigned char *p = (unsigned char*)pool.calloc(1, size + i * 16);
+        CHECK(p != NULL);
+        if (!p)
+            continue;
+        size_t nonzero = 0;
+        for (size_t k = 0; k < size + i * 16; k++)
+            nonzero += p[k] != 0;
+        CHECK(nonzero == 0);
+        memset(p, 0x5a, size + i * 16);
+        blocks[i] = p;
+    }
+    for (size_t i = 0; i < count; i++)
+        pool.free(blocks[i]);
+}
+
+#if defined(__linux__) && !defined(DISABLE_THREAD_CACHE)
+// A real-time thread makes no syscall: a forked child registers, then runs under strict seccomp,
+// where any syscall but read/write/exit kills it, and reports what its allocations returned
+static void test_realtime()
+{
+    int fds[2];
+    CHECK(pipe(fds) == 0);
+    pid_t pid = fork();
+    if (pid == 0) {
+        char *huge = (char*)bigpool.malloc(100 * MBYTE);
+        bool ok = huge && bigpool.RegisterRealtimeThread(8);
+        if (ok && prctl(PR_SET_SECCOMP, SECCOMP_MODE_STRICT) == 0) {
+            void *small = bigpool.malloc(100);
+            ok = small != NULL;
+            bigpool.free(small);
+            
+            errno = 0;
+            ok = ok && bigpool.realloc(huge, 200 * MBYTE) == NULL && errno == ENOMEM;
+            ok = ok && bigpool.realloc(huge, 50 * MBYTE) == NULL;
+            ok = ok && bigpool.malloc(1 * MBYTE) == NULL && bigpool.calloc(1, 1 * MBYTE) == NULL;
+            ok = ok && bigpool.GetRealtimeFailures() == 4;
+            huge[100 * MBYTE - 1] = 1;
+            
+            // freeing the mapping only queues it
+            size_t mapped = bigpool.GetHugeSize();
+            bigpool.free(huge);
+            ok = ok && bigpool.GetHugeSize() == mapped;
+        } else {
+            ok = false;
+        }
+        char result = ok ? 'y' : 'n';
+        ssize_t written = write(fds[1], &result, 1);
+        syscall(SYS_exit, written == 1 ? 0 : 1);
+    }
+    close(fds[1]);
+    char result = 0;
+    CHECK(read(fds[0], &result, 1) == 1 && result == 'y');
+    close(fds[0]);
+    int status = 0;
+    CHECK(waitpid(pid, &status, 0) == pid && WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    
+    // a huge block a real-time thread freed is unmapped by Trim
+    size_t mapped = bigpool.GetHugeSize();
+    char *huge = (char*)bigpool.malloc(100 * MBYTE);
+    CHECK(huge && bigpool.GetHugeSize() == mapped + 100 * MBYTE);
+    std::thread([huge]() {
+        CHECK(bigpool.RegisterRealtimeThread(8));
+        bigpool.free(huge);
+        bigpool.UnregisterRealtimeThread();
+    }).join();
+    CHECK(bigpool.GetHugeSize() == mapped + 100 * MBYTE);
+    bigpool.Trim();
+    CHECK(bigpool.GetHugeSize() == mapped);
+}
+#endif
+
+int main()
+{
+    test_atomic_lock();
+    test_atomic_sema();
+    test_memalign();
+    test_thread_cache();
+    test_pool_lifetime();
+    test_pool_reuse();
+    test_coalesce();
+    test_batch();
+#ifndef FREEDOM_STACK_ALLOC
+    test_batch_grow();
+#endif
+    test_free_sized();
+    test_object_pool();
+    test_object_pool_reuse();
+    test_allocator();
+    test_arena();
+    test_placement();
+#ifndef DISABLE_THREAD_CACHE
+    test_remote_free();
+#endif
+    test_alignment();
+#ifndef DISABLE_STATS
+    test_stats();
+#endif
+    test_calloc();
+    test_fragmentation();
+    test_try_expand();
+    test_try_expand_huge();
+#ifndef FREEDOM_STACK_ALLOC
+    test_grow_arenas();
+#endif
+#ifdef FREEDOM_STACK_ALLOC
+    test_small_pools();
+#endif
+    test_trim();
+#if defined(__linux__) && !defined(DISABLE_THREAD_CACHE)
+    test_realtime();
+#endif
+    
+    if (failures)
+        fprintf(stderr, "%d checks failed\n", failures);
+    else
+        printf("all tests passed\n");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,34 @@
+//  trace_test.cpp - traced program for the trace round trip of make check
+//
+//  Built with FREEDOM_TRACE and the overrides on. Each round makes TRACE_TEST_OPS traced calls, on top of
+//  whatever the runtime allocates by itself, which is the same for any number of rounds. tests/Makefile
+//  records a trace of 0 and of TRACE_TEST_ROUNDS rounds and checks that bench/replay reads the difference.
+//
+//  usage: trace_test rounds
+
+#include "freedom_pool.h"
+
+#include <stdlib.h>
+
+#define TRACE_TEST_OPS  9
+
+// keeps the compiler from pairing up and dropping the allocations
+static void *volatile sink;
+
+int main(int argc, char** argv)
+{
+    int rounds = argc > 1 ? atoi(argv[1]) : 0;
+    for (int i = 0; i < rounds; i++) {
+        char *a = (char*)malloc(100);
+        char *b = (char*)calloc(10, 100);
+        a = (char*)realloc(a, 5000);
+        char *c = (char*)aligned_alloc(64, 256);
+        char *d = new char[64];
+        sink = a; sink = b; sink = c; sink = d;
+        delete[] d;
+        free(c);
+        free(b);
+        free(a);
+    }
+    return 0;
+}